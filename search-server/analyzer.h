@@ -0,0 +1,173 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+// Text analysis pipeline shared by indexing and query parsing: a tokenizer,
+// a normalizer and a stop filter, each a policy type, composed at compile
+// time so that the per-word loop has no indirect calls.
+//
+// Normalizers are length-preserving and work in place on the whole text
+// before tokenization, so the terms stay views of the analyzed buffer.
+
+// Splits on ' ' only and keeps empty tokens, as SplitIntoWords does
+struct SpaceTokenizer {
+    template <typename Function>
+    static void Tokenize(std::string_view text, Function function) {
+        while (true) {
+            const size_t space = text.find(' ');
+            function(text.substr(0, space));
+            if (space == text.npos) {
+                break;
+            }
+            text.remove_prefix(space + 1);
+        }
+    }
+};
+
+// Splits on any ASCII whitespace and skips empty tokens
+struct WhitespaceTokenizer {
+    static bool IsSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+    }
+
+    template <typename Function>
+    static void Tokenize(std::string_view text, Function function) {
+        size_t position = 0;
+        while (position < text.size()) {
+            while (position < text.size() && IsSpace(text[position])) {
+                ++position;
+            }
+            const size_t begin = position;
+            while (position < text.size() && !IsSpace(text[position])) {
+                ++position;
+            }
+            if (position > begin) {
+                function(text.substr(begin, position - begin));
+            }
+        }
+    }
+};
+
+struct IdentityNormalizer {
+    static constexpr bool MODIFIES_TEXT = false;
+
+    static void Normalize(char*, size_t) {
+    }
+};
+
+// Lowercases ASCII, Latin-1 letters and the Cyrillic block U+0400-U+042F in
+// UTF-8. These mappings keep the encoded length; other characters are left
+// as they are.
+struct CaseFoldNormalizer {
+    static constexpr bool MODIFIES_TEXT = true;
+
+    static void Normalize(char* text, size_t size) {
+        size_t i = 0;
+        while (i < size) {
+            // ASCII fast path: fold eight bytes at a time while no byte has
+            // the high bit set
+            for (; i + 8 <= size; i += 8) {
+                uint64_t chunk;
+                std::memcpy(&chunk, text + i, 8);
+                if ((chunk & 0x8080808080808080ULL) != 0) {
+                    break;
+                }
+                const uint64_t above_z = chunk + 0x2525252525252525ULL;
+                const uint64_t from_a = chunk + 0x3F3F3F3F3F3F3F3FULL;
+                const uint64_t is_upper = from_a & ~above_z & 0x8080808080808080ULL;
+                chunk |= is_upper >> 2;
+                std::memcpy(text + i, &chunk, 8);
+            }
+            if (i >= size) {
+                break;
+            }
+            const unsigned char byte = static_cast<unsigned char>(text[i]);
+            if (byte < 0x80) {
+                if (byte >= 'A' && byte <= 'Z') {
+                    text[i] = static_cast<char>(byte | 0x20);
+                }
+                ++i;
+                continue;
+            }
+            if (i + 1 < size) {
+                FoldTwoByteSequence(reinterpret_cast<unsigned char*>(text + i));
+            }
+            ++i;
+            // Skip the continuation bytes of the sequence
+            while (i < size && (static_cast<unsigned char>(text[i]) & 0xC0) == 0x80) {
+                ++i;
+            }
+        }
+    }
+
+private:
+    static void FoldTwoByteSequence(unsigned char* sequence) {
+        const unsigned char lead = sequence[0];
+        const unsigned char next = sequence[1];
+        if (lead == 0xC3) {
+            // U+00C0-U+00DE except the multiplication sign U+00D7
+            if (next >= 0x80 && next <= 0x9E && next != 0x97) {
+                sequence[1] = static_cast<unsigned char>(next + 0x20);
+            }
+        }
+        else if (lead == 0xD0) {
+            if (next >= 0x80 && next <= 0x8F) {
+                // U+0400-U+040F to U+0450-U+045F
+                sequence[0] = 0xD1;
+                sequence[1] = static_cast<unsigned char>(next + 0x10);
+            }
+            else if (next >= 0x90 && next <= 0x9F) {
+                // U+0410-U+041F to U+0430-U+043F
+                sequence[1] = static_cast<unsigned char>(next + 0x20);
+            }
+            else if (next >= 0xA0 && next <= 0xAF) {
+                // U+0420-U+042F to U+0440-U+044F
+                sequence[0] = 0xD1;
+                sequence[1] = static_cast<unsigned char>(next - 0x20);
+            }
+        }
+    }
+};
+
+struct NoStopFilter {
+    bool operator()(std::string_view) const {
+        return false;
+    }
+};
+
+template <typename Tokenizer, typename Normalizer>
+struct Analyzer {
+    // Normalizes the text in place and calls function(word) for every token
+    // the stop filter does not reject
+    template <typename StopFilter, typename Function>
+    static void Analyze(std::string& text, const StopFilter& stop_filter, Function function) {
+        Normalizer::Normalize(text.data(), text.size());
+        Tokenizer::Tokenize(text, [&stop_filter, &function](std::string_view word) {
+            if (!stop_filter(word)) {
+                function(word);
+            }
+            });
+    }
+};
+
+// Runtime choice of the pipeline, resolved once per analyzed text
+struct TextAnalysis {
+    // Lowercase documents, queries and stop words
+    bool fold_case = false;
+    // Split on any whitespace and skip empty words instead of splitting on ' '
+    bool split_on_whitespace = false;
+};
+
+// Calls function(Tokenizer{}, Normalizer{}) with the policies selected by the
+// analysis options
+template <typename Function>
+decltype(auto) VisitAnalyzer(const TextAnalysis& analysis, Function function) {
+    if (analysis.split_on_whitespace) {
+        return analysis.fold_case ? function(WhitespaceTokenizer{}, CaseFoldNormalizer{})
+            : function(WhitespaceTokenizer{}, IdentityNormalizer{});
+    }
+    return analysis.fold_case ? function(SpaceTokenizer{}, CaseFoldNormalizer{})
+        : function(SpaceTokenizer{}, IdentityNormalizer{});
+}
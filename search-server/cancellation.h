@@ -0,0 +1,81 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+
+// Stops a search cooperatively: at a deadline, when another thread calls
+// Cancel, or both. A search that sees it fire ranks the documents it has
+// scored so far and reports itself truncated.
+class CancellationToken {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    CancellationToken() = default;
+    explicit CancellationToken(Clock::time_point deadline)
+        : deadline_(deadline) {
+    }
+
+    static CancellationToken WithTimeout(Clock::duration timeout) {
+        return CancellationToken(Clock::now() + timeout);
+    }
+
+    CancellationToken(const CancellationToken&) = delete;
+    CancellationToken& operator=(const CancellationToken&) = delete;
+
+    void Cancel() {
+        cancelled_.store(true, std::memory_order_relaxed);
+    }
+
+    bool IsCancelled() const {
+        return cancelled_.load(std::memory_order_relaxed) || Clock::now() >= deadline_;
+    }
+
+private:
+    Clock::time_point deadline_ = Clock::time_point::max();
+    std::atomic<bool> cancelled_ = false;
+};
+
+// Cancellation state of one search on one thread. Scoring loops call Poll
+// per posting, and the token is read only every CHECK_INTERVAL calls: a
+// clock read per posting would cost more than the scoring.
+class CancellationCheck {
+public:
+    static constexpr size_t CHECK_INTERVAL = 1024;
+
+    explicit CancellationCheck(const CancellationToken* token)
+        : token_(token) {
+    }
+
+    bool Poll() {
+        if (--countdown_ == 0) {
+            countdown_ = CHECK_INTERVAL;
+            return Check();
+        }
+        return cancelled_;
+    }
+
+    // Reads the token now
+    bool Check() {
+        if (!cancelled_ && token_ != nullptr && token_->IsCancelled()) {
+            cancelled_ = true;
+        }
+        return cancelled_;
+    }
+
+    bool IsCancelled() const {
+        return cancelled_;
+    }
+
+    void MarkCancelled() {
+        cancelled_ = true;
+    }
+
+    const CancellationToken* GetToken() const {
+        return token_;
+    }
+
+private:
+    const CancellationToken* token_;
+    size_t countdown_ = 1;
+    bool cancelled_ = false;
+};
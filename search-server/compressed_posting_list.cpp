@@ -0,0 +1,190 @@
+#include "compressed_posting_list.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// The bit unpacker reads 8 bytes at a time, so the data always ends with padding
+const size_t DATA_PADDING = sizeof(uint64_t);
+
+uint8_t BitWidth(uint32_t value) {
+    uint8_t width = 0;
+    for (; value != 0; value >>= 1) {
+        ++width;
+    }
+    return width;
+}
+
+} // namespace
+
+CompressedPostingList::CompressedPostingList(const std::vector<std::pair<uint32_t, double>>& postings,
+    TermFreqEncoding encoding)
+    : size_(postings.size())
+    , encoding_(encoding) {
+    blocks_.reserve((postings.size() + BLOCK_SIZE - 1) / BLOCK_SIZE);
+    uint32_t previous = 0;
+    for (size_t begin = 0; begin < postings.size(); begin += BLOCK_SIZE) {
+        const size_t end = std::min(begin + BLOCK_SIZE, postings.size());
+
+        BlockHeader header{};
+        header.offset = data_.size();
+        header.last_document = postings[end - 1].first;
+
+        // The first delta of a block is taken against the previous block, so a
+        // cursor only needs the block headers to start decoding anywhere
+        uint32_t max_delta = 0;
+        for (size_t i = begin; i < end; ++i) {
+            max_delta = std::max(max_delta, postings[i].first - (i == 0 ? 0 : postings[i - 1].first));
+        }
+        header.bit_width = BitWidth(max_delta);
+
+        const size_t packed_bytes = ((end - begin) * header.bit_width + 7) / 8;
+        std::vector<uint8_t> packed(packed_bytes + DATA_PADDING);
+        size_t bit_position = 0;
+        for (size_t i = begin; i < end; ++i, bit_position += header.bit_width) {
+            const uint64_t delta = postings[i].first - previous;
+            previous = postings[i].first;
+            uint64_t word;
+            std::memcpy(&word, packed.data() + (bit_position >> 3), sizeof(word));
+            word |= delta << (bit_position & 7);
+            std::memcpy(packed.data() + (bit_position >> 3), &word, sizeof(word));
+        }
+        data_.insert(data_.end(), packed.begin(), packed.begin() + packed_bytes);
+
+        double max_term_freq = 0;
+        for (size_t i = begin; i < end; ++i) {
+            max_term_freq = std::max(max_term_freq, postings[i].second);
+        }
+        header.term_freq_scale = static_cast<float>(max_term_freq);
+        for (size_t i = begin; i < end; ++i) {
+            const double term_freq = postings[i].second;
+            const double ratio = max_term_freq > 0 ? term_freq / max_term_freq : 0.0;
+            if (encoding_ == TermFreqEncoding::FLOAT32) {
+                const float value = static_cast<float>(term_freq);
+                uint8_t bytes[sizeof(value)];
+                std::memcpy(bytes, &value, sizeof(value));
+                data_.insert(data_.end(), bytes, bytes + sizeof(bytes));
+            }
+            else if (encoding_ == TermFreqEncoding::QUANTIZED_16) {
+                const uint16_t value = static_cast<uint16_t>(std::lround(ratio * UINT16_MAX));
+                data_.push_back(static_cast<uint8_t>(value));
+                data_.push_back(static_cast<uint8_t>(value >> 8));
+            }
+            else {
+                data_.push_back(static_cast<uint8_t>(std::lround(ratio * UINT8_MAX)));
+            }
+        }
+        blocks_.push_back(header);
+    }
+    data_.resize(data_.size() + DATA_PADDING);
+    data_.shrink_to_fit();
+}
+
+size_t CompressedPostingList::size() const {
+    return size_;
+}
+
+bool CompressedPostingList::empty() const {
+    return size_ == 0;
+}
+
+size_t CompressedPostingList::GetMemoryUsage() const {
+    return sizeof(*this) + blocks_.capacity() * sizeof(BlockHeader) + data_.capacity();
+}
+
+size_t CompressedPostingList::GetBlockSize(size_t block) const {
+    return block + 1 == blocks_.size() ? size_ - block * BLOCK_SIZE : BLOCK_SIZE;
+}
+
+void CompressedPostingList::DecodeBlock(size_t block, uint32_t* documents, float* term_freqs) const {
+    const BlockHeader& header = blocks_[block];
+    const size_t block_size = GetBlockSize(block);
+    const uint8_t* packed = data_.data() + header.offset;
+    const uint64_t mask = (uint64_t{ 1 } << header.bit_width) - 1;
+
+    uint32_t document = block == 0 ? 0 : blocks_[block - 1].last_document;
+    size_t bit_position = 0;
+    for (size_t i = 0; i < block_size; ++i, bit_position += header.bit_width) {
+        uint64_t word;
+        std::memcpy(&word, packed + (bit_position >> 3), sizeof(word));
+        document += static_cast<uint32_t>((word >> (bit_position & 7)) & mask);
+        documents[i] = document;
+    }
+
+    const uint8_t* freqs = packed + (block_size * header.bit_width + 7) / 8;
+    switch (encoding_) {
+    case TermFreqEncoding::FLOAT32:
+        std::memcpy(term_freqs, freqs, block_size * sizeof(float));
+        break;
+    case TermFreqEncoding::QUANTIZED_16:
+        for (size_t i = 0; i < block_size; ++i) {
+            const uint16_t value = freqs[2 * i] | (freqs[2 * i + 1] << 8);
+            term_freqs[i] = header.term_freq_scale * value / UINT16_MAX;
+        }
+        break;
+    case TermFreqEncoding::QUANTIZED_8:
+        for (size_t i = 0; i < block_size; ++i) {
+            term_freqs[i] = header.term_freq_scale * freqs[i] / UINT8_MAX;
+        }
+        break;
+    }
+}
+
+CompressedPostingList::Cursor::Cursor(const CompressedPostingList& list)
+    : list_(&list) {
+    if (!list_->blocks_.empty()) {
+        LoadBlock(0);
+    }
+}
+
+void CompressedPostingList::Cursor::LoadBlock(size_t block) {
+    block_ = block;
+    position_ = 0;
+    block_size_ = list_->GetBlockSize(block);
+    list_->DecodeBlock(block, documents_.data(), term_freqs_.data());
+}
+
+bool CompressedPostingList::Cursor::AtEnd() const {
+    return block_ >= list_->blocks_.size();
+}
+
+uint32_t CompressedPostingList::Cursor::GetDocument() const {
+    return documents_[position_];
+}
+
+double CompressedPostingList::Cursor::GetTermFreq() const {
+    return term_freqs_[position_];
+}
+
+void CompressedPostingList::Cursor::Next() {
+    if (++position_ < block_size_) {
+        return;
+    }
+    if (block_ + 1 < list_->blocks_.size()) {
+        LoadBlock(block_ + 1);
+    }
+    else {
+        block_ = list_->blocks_.size();
+    }
+}
+
+void CompressedPostingList::Cursor::SkipTo(uint32_t target) {
+    if (AtEnd()) {
+        return;
+    }
+    if (list_->blocks_[block_].last_document < target) {
+        // Skip the blocks that end before the target by their headers alone
+        const auto it = std::lower_bound(list_->blocks_.begin() + block_ + 1, list_->blocks_.end(), target,
+            [](const BlockHeader& header, uint32_t value) {
+                return header.last_document < value;
+            });
+        if (it == list_->blocks_.end()) {
+            block_ = list_->blocks_.size();
+            return;
+        }
+        LoadBlock(it - list_->blocks_.begin());
+    }
+    position_ = std::lower_bound(documents_.begin() + position_, documents_.begin() + block_size_, target)
+        - documents_.begin();
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+enum class TermFreqEncoding : uint8_t {
+    FLOAT32,
+    // Quantized against the largest term frequency of the block
+    QUANTIZED_16,
+    QUANTIZED_8,
+};
+
+// Read-only posting list of ascending document numbers with term frequencies.
+// Postings are stored in blocks of BLOCK_SIZE: document numbers as bit-packed
+// deltas, term frequencies as float or quantized integers. Block headers keep
+// the last document number of every block, so a cursor skips whole blocks
+// without decoding them.
+class CompressedPostingList {
+public:
+    static constexpr size_t BLOCK_SIZE = 128;
+
+    CompressedPostingList() = default;
+    // Postings must be sorted by document number without repetitions
+    CompressedPostingList(const std::vector<std::pair<uint32_t, double>>& postings, TermFreqEncoding encoding);
+
+    size_t size() const;
+    bool empty() const;
+    size_t GetMemoryUsage() const;
+
+    class Cursor {
+    public:
+        explicit Cursor(const CompressedPostingList& list);
+
+        bool AtEnd() const;
+        uint32_t GetDocument() const;
+        double GetTermFreq() const;
+
+        void Next();
+        // Moves to the first posting with a document number not less than target
+        void SkipTo(uint32_t target);
+
+    private:
+        const CompressedPostingList* list_;
+        size_t block_ = 0;
+        size_t position_ = 0;
+        size_t block_size_ = 0;
+        std::array<uint32_t, BLOCK_SIZE> documents_;
+        std::array<float, BLOCK_SIZE> term_freqs_;
+
+        void LoadBlock(size_t block);
+    };
+
+    template <typename Function>
+    void ForEach(Function function) const;
+
+private:
+    struct BlockHeader {
+        uint32_t last_document;
+        uint32_t offset;
+        float term_freq_scale;
+        uint8_t bit_width;
+    };
+
+    std::vector<BlockHeader> blocks_;
+    std::vector<uint8_t> data_;
+    uint32_t size_ = 0;
+    TermFreqEncoding encoding_ = TermFreqEncoding::FLOAT32;
+
+    size_t GetBlockSize(size_t block) const;
+    void DecodeBlock(size_t block, uint32_t* documents, float* term_freqs) const;
+};
+
+template <typename Function>
+void CompressedPostingList::ForEach(Function function) const {
+    std::array<uint32_t, BLOCK_SIZE> documents;
+    std::array<float, BLOCK_SIZE> term_freqs;
+    for (size_t block = 0; block < blocks_.size(); ++block) {
+        DecodeBlock(block, documents.data(), term_freqs.data());
+        const size_t block_size = GetBlockSize(block);
+        for (size_t i = 0; i < block_size; ++i) {
+            function(documents[i], static_cast<double>(term_freqs[i]));
+        }
+    }
+}
@@ -1,4 +1,5 @@
 #include "document.h"
+#include <numeric>
 
 using namespace std::string_literals;
 
@@ -14,6 +15,12 @@ std::ostream& operator<<(std::ostream& out, const Document& document) {
         << "rating = "s << document.rating << " }"s;
     return out;
 }
+int ComputeAverageRating(const std::vector<int>& ratings) {
+    if (ratings.empty()) {
+        return 0;
+    }
+    return std::accumulate(ratings.begin(), ratings.end(), 0) / static_cast<int>(ratings.size());
+}
 void PrintDocument(const Document& document) {
     std::cout << "{ "s
         << "document_id = "s << document.id << ", "s
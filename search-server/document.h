@@ -16,5 +16,7 @@ enum class DocumentStatus {
     BANNED,
     REMOVED,
 };
+// Integer mean of the ratings, 0 when there are none
+int ComputeAverageRating(const std::vector<int>& ratings);
 void PrintDocument(const Document& document);
 void PrintMatchDocumentResult(int document_id, const std::vector<std::string_view>& words, DocumentStatus status);
\ No newline at end of file
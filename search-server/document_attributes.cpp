@@ -0,0 +1,148 @@
+#include "document_attributes.h"
+#include "memory_stats.h"
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DOCUMENT_ATTRIBUTES_SSE2
+#include <emmintrin.h>
+#endif
+
+uint32_t DocumentAttributes::Add(int document_id, int rating, DocumentStatus status) {
+    uint32_t slot;
+    if (free_slots_.empty()) {
+        slot = static_cast<uint32_t>(document_ids_.size());
+        document_ids_.push_back(document_id);
+        ratings_.push_back(rating);
+        statuses_.push_back(static_cast<uint8_t>(status));
+    }
+    else {
+        slot = free_slots_.back();
+        free_slots_.pop_back();
+        document_ids_[slot] = document_id;
+        ratings_[slot] = rating;
+        statuses_[slot] = static_cast<uint8_t>(status);
+    }
+    slots_.emplace(document_id, slot);
+    documents_.Set(slot);
+    status_documents_[static_cast<size_t>(status)].Set(slot);
+    ++status_document_counts_[static_cast<size_t>(status)];
+    return slot;
+}
+
+void DocumentAttributes::Remove(int document_id) {
+    const auto it = slots_.find(document_id);
+    if (it == slots_.end()) {
+        return;
+    }
+    const uint32_t slot = it->second;
+    const size_t status = statuses_[slot];
+    documents_.Reset(slot);
+    status_documents_[status].Reset(slot);
+    --status_document_counts_[status];
+    free_slots_.push_back(slot);
+    slots_.erase(it);
+}
+
+void DocumentAttributes::SetRating(uint32_t slot, int rating) {
+    ratings_[slot] = rating;
+}
+
+void DocumentAttributes::SetStatus(uint32_t slot, DocumentStatus status) {
+    const size_t old_status = statuses_[slot];
+    const size_t new_status = static_cast<size_t>(status);
+    status_documents_[old_status].Reset(slot);
+    --status_document_counts_[old_status];
+    status_documents_[new_status].Set(slot);
+    ++status_document_counts_[new_status];
+    statuses_[slot] = static_cast<uint8_t>(status);
+}
+
+size_t DocumentAttributes::GetDocumentCount() const {
+    return slots_.size();
+}
+
+const DocumentBitset& DocumentAttributes::GetStatusDocuments(DocumentStatus status) const {
+    return status_documents_[static_cast<size_t>(status)];
+}
+
+size_t DocumentAttributes::GetStatusDocumentCount(DocumentStatus status) const {
+    return status_document_counts_[static_cast<size_t>(status)];
+}
+
+DocumentBitset DocumentAttributes::Filter(const DocumentFilter& filter) const {
+    DocumentBitset result(ratings_.size());
+    if (filter.min_rating == std::numeric_limits<int>::min() && filter.max_rating == std::numeric_limits<int>::max()) {
+        result |= documents_;
+    }
+    else {
+        FilterRatingRange(ratings_.data(), ratings_.size(), filter.min_rating, filter.max_rating,
+            result.GetWords().data());
+        result &= documents_;
+    }
+    if (!filter.statuses.empty()) {
+        DocumentBitset statuses(ratings_.size());
+        for (const DocumentStatus status : filter.statuses) {
+            statuses |= status_documents_[static_cast<size_t>(status)];
+        }
+        result &= statuses;
+    }
+    return result;
+}
+
+size_t DocumentAttributes::GetMemoryUsage() const {
+    size_t result = EstimateHashNodes(slots_)
+        + EstimateAllocation(free_slots_.capacity() * sizeof(uint32_t))
+        + EstimateAllocation(document_ids_.capacity() * sizeof(int))
+        + EstimateAllocation(ratings_.capacity() * sizeof(int))
+        + EstimateAllocation(statuses_.capacity())
+        + EstimateAllocation(documents_.GetWords().capacity() * sizeof(uint64_t));
+    for (const DocumentBitset& bitset : status_documents_) {
+        result += EstimateAllocation(bitset.GetWords().capacity() * sizeof(uint64_t));
+    }
+    return result;
+}
+
+void FilterRatingRange(const int* ratings, size_t count, int min_rating, int max_rating, uint64_t* words) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i min_vector = _mm256_set1_epi32(min_rating);
+    const __m256i max_vector = _mm256_set1_epi32(max_rating);
+    for (; i + 64 <= count; i += 64) {
+        uint64_t word = 0;
+        for (size_t lane = 0; lane < 64; lane += 8) {
+            const __m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ratings + i + lane));
+            const __m256i outside = _mm256_or_si256(_mm256_cmpgt_epi32(min_vector, values),
+                _mm256_cmpgt_epi32(values, max_vector));
+            const uint64_t mask = ~_mm256_movemask_ps(_mm256_castsi256_ps(outside)) & 0xFF;
+            word |= mask << lane;
+        }
+        words[i / 64] = word;
+    }
+#elif defined(DOCUMENT_ATTRIBUTES_SSE2)
+    const __m128i min_vector = _mm_set1_epi32(min_rating);
+    const __m128i max_vector = _mm_set1_epi32(max_rating);
+    for (; i + 64 <= count; i += 64) {
+        uint64_t word = 0;
+        for (size_t lane = 0; lane < 64; lane += 4) {
+            const __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ratings + i + lane));
+            const __m128i outside = _mm_or_si128(_mm_cmpgt_epi32(min_vector, values),
+                _mm_cmpgt_epi32(values, max_vector));
+            const uint64_t mask = ~_mm_movemask_ps(_mm_castsi128_ps(outside)) & 0xF;
+            word |= mask << lane;
+        }
+        words[i / 64] = word;
+    }
+#endif
+    // Branch-free scalar tail, also the whole kernel without SIMD support
+    for (; i < count; i += 64) {
+        const size_t lanes = std::min<size_t>(64, count - i);
+        uint64_t word = 0;
+        for (size_t lane = 0; lane < lanes; ++lane) {
+            const int value = ratings[i + lane];
+            word |= static_cast<uint64_t>((value >= min_rating) & (value <= max_rating)) << lane;
+        }
+        words[i / 64] = word;
+    }
+}
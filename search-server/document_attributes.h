@@ -0,0 +1,88 @@
+#pragma once
+#include "document.h"
+#include "document_bitset.h"
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+// Declarative document filter, e.g. rating >= 3 and status in {ACTUAL, IRRELEVANT}
+struct DocumentFilter {
+    int min_rating = std::numeric_limits<int>::min();
+    int max_rating = std::numeric_limits<int>::max();
+    // Any status when empty
+    std::vector<DocumentStatus> statuses;
+};
+
+constexpr size_t DOCUMENT_STATUS_COUNT = static_cast<size_t>(DocumentStatus::REMOVED) + 1;
+
+// Rating and status of the documents as columns, so that filters are
+// evaluated in bulk into candidate bitsets. Every document is given a slot,
+// a dense number the index uses in place of its id: columns, bitsets and
+// posting lists stay proportional to the document count however large or
+// sparse the ids are. Slots of removed documents are reused.
+class DocumentAttributes {
+public:
+    // Returns the slot of the document, which must be absent
+    uint32_t Add(int document_id, int rating, DocumentStatus status);
+    // Frees the slot of the document
+    void Remove(int document_id);
+    // The slot must be in use
+    void SetRating(uint32_t slot, int rating);
+    void SetStatus(uint32_t slot, DocumentStatus status);
+
+    bool Contains(int document_id) const;
+    // Throws out_of_range for a missing document
+    uint32_t GetSlot(int document_id) const;
+    int GetDocumentId(uint32_t slot) const;
+    int GetRating(uint32_t slot) const;
+    DocumentStatus GetStatus(uint32_t slot) const;
+
+    size_t GetDocumentCount() const;
+    // All slots in use are below this bound
+    size_t GetSlotBound() const;
+    const DocumentBitset& GetStatusDocuments(DocumentStatus status) const;
+    size_t GetStatusDocumentCount(DocumentStatus status) const;
+
+    DocumentBitset Filter(const DocumentFilter& filter) const;
+
+    size_t GetMemoryUsage() const;
+
+private:
+    std::unordered_map<int, uint32_t> slots_;
+    std::vector<uint32_t> free_slots_;
+    std::vector<int> document_ids_;
+    std::vector<int> ratings_;
+    std::vector<uint8_t> statuses_;
+    DocumentBitset documents_;
+    std::array<DocumentBitset, DOCUMENT_STATUS_COUNT> status_documents_;
+    std::array<size_t, DOCUMENT_STATUS_COUNT> status_document_counts_{};
+};
+
+// Sets bit i of words when min_rating <= ratings[i] <= max_rating
+void FilterRatingRange(const int* ratings, size_t count, int min_rating, int max_rating, uint64_t* words);
+
+inline bool DocumentAttributes::Contains(int document_id) const {
+    return slots_.count(document_id) > 0;
+}
+
+inline uint32_t DocumentAttributes::GetSlot(int document_id) const {
+    return slots_.at(document_id);
+}
+
+inline int DocumentAttributes::GetDocumentId(uint32_t slot) const {
+    return document_ids_[slot];
+}
+
+inline int DocumentAttributes::GetRating(uint32_t slot) const {
+    return ratings_[slot];
+}
+
+inline size_t DocumentAttributes::GetSlotBound() const {
+    return document_ids_.size();
+}
+
+inline DocumentStatus DocumentAttributes::GetStatus(uint32_t slot) const {
+    return static_cast<DocumentStatus>(statuses_[slot]);
+}
@@ -0,0 +1,70 @@
+#include "document_bitset.h"
+#include <algorithm>
+
+DocumentBitset::DocumentBitset(size_t size) {
+    Resize(size);
+}
+
+void DocumentBitset::Set(size_t index) {
+    if (index >= size_) {
+        Resize(std::max(index + 1, size_ * 2));
+    }
+    words_[index >> 6] |= uint64_t{ 1 } << (index & 63);
+}
+
+void DocumentBitset::Reset(size_t index) {
+    if (index < size_) {
+        words_[index >> 6] &= ~(uint64_t{ 1 } << (index & 63));
+    }
+}
+
+size_t DocumentBitset::Count() const {
+    size_t count = 0;
+    for (const uint64_t word : words_) {
+        count += PopCount64(word);
+    }
+    return count;
+}
+
+size_t DocumentBitset::Size() const {
+    return size_;
+}
+
+void DocumentBitset::Resize(size_t size) {
+    words_.resize((size + 63) / 64);
+    if (size < size_ && (size & 63) != 0) {
+        words_.back() &= (uint64_t{ 1 } << (size & 63)) - 1;
+    }
+    size_ = size;
+}
+
+void DocumentBitset::Clear() {
+    std::fill(words_.begin(), words_.end(), 0);
+}
+
+DocumentBitset& DocumentBitset::operator&=(const DocumentBitset& other) {
+    const size_t common = std::min(words_.size(), other.words_.size());
+    for (size_t i = 0; i < common; ++i) {
+        words_[i] &= other.words_[i];
+    }
+    std::fill(words_.begin() + common, words_.end(), 0);
+    return *this;
+}
+
+DocumentBitset& DocumentBitset::operator|=(const DocumentBitset& other) {
+    if (other.size_ > size_) {
+        Resize(other.size_);
+    }
+    for (size_t i = 0; i < other.words_.size(); ++i) {
+        words_[i] |= other.words_[i];
+    }
+    return *this;
+}
+
+const std::vector<uint64_t>& DocumentBitset::GetWords() const {
+    return words_;
+}
+
+std::vector<uint64_t>& DocumentBitset::GetWords() {
+    return words_;
+}
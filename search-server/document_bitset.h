@@ -0,0 +1,74 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+inline size_t PopCount64(uint64_t word) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(word);
+#else
+    word = word - ((word >> 1) & 0x5555555555555555ULL);
+    word = (word & 0x3333333333333333ULL) + ((word >> 2) & 0x3333333333333333ULL);
+    word = (word + (word >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return static_cast<size_t>((word * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+// The word must not be zero
+inline size_t CountTrailingZeros64(uint64_t word) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(word);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return index;
+#else
+    return PopCount64((word & (0 - word)) - 1);
+#endif
+}
+
+// Growable bitset over non-negative document numbers, stored as 64-bit words
+// so that filters combine a whole word of documents per operation.
+class DocumentBitset {
+public:
+    DocumentBitset() = default;
+    explicit DocumentBitset(size_t size);
+
+    void Set(size_t index);
+    void Reset(size_t index);
+    bool Test(size_t index) const;
+
+    size_t Count() const;
+    size_t Size() const;
+    void Resize(size_t size);
+    void Clear();
+
+    DocumentBitset& operator&=(const DocumentBitset& other);
+    DocumentBitset& operator|=(const DocumentBitset& other);
+
+    const std::vector<uint64_t>& GetWords() const;
+    std::vector<uint64_t>& GetWords();
+
+    template <typename Function>
+    void ForEach(Function function) const;
+
+private:
+    std::vector<uint64_t> words_;
+    size_t size_ = 0;
+};
+
+inline bool DocumentBitset::Test(size_t index) const {
+    return index < size_ && (words_[index >> 6] >> (index & 63) & 1) != 0;
+}
+
+template <typename Function>
+void DocumentBitset::ForEach(Function function) const {
+    for (size_t word_index = 0; word_index < words_.size(); ++word_index) {
+        for (uint64_t word = words_[word_index]; word != 0; word &= word - 1) {
+            function((word_index << 6) + CountTrailingZeros64(word));
+        }
+    }
+}
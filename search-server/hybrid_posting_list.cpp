@@ -0,0 +1,389 @@
+#include "hybrid_posting_list.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+using namespace std::string_literals;
+
+HybridPostingList::Chunk::Chunk(uint32_t key, const allocator_type& allocator)
+    : key(key)
+    , lows(allocator)
+    , bits(allocator)
+    , ranks(allocator)
+    , term_freqs(allocator) {
+}
+
+HybridPostingList::Chunk::Chunk(const Chunk& other, const allocator_type& allocator)
+    : key(other.key)
+    , lows(other.lows, allocator)
+    , bits(other.bits, allocator)
+    , ranks(other.ranks, allocator)
+    , term_freqs(other.term_freqs, allocator) {
+}
+
+HybridPostingList::Chunk::Chunk(Chunk&& other, const allocator_type& allocator)
+    : key(other.key)
+    , lows(std::move(other.lows), allocator)
+    , bits(std::move(other.bits), allocator)
+    , ranks(std::move(other.ranks), allocator)
+    , term_freqs(std::move(other.term_freqs), allocator) {
+}
+
+bool HybridPostingList::Chunk::Contains(uint32_t low) const {
+    if (IsBitmap()) {
+        return (bits[low >> 6] >> (low & 63) & 1) != 0;
+    }
+    return std::binary_search(lows.begin(), lows.end(), low);
+}
+
+size_t HybridPostingList::Chunk::Rank(uint32_t low) const {
+    if (IsBitmap()) {
+        if (low >> 6 >= BITMAP_WORDS) {
+            return size();
+        }
+        const uint64_t below = (uint64_t{ 1 } << (low & 63)) - 1;
+        return ranks[low >> 6] + PopCount64(bits[low >> 6] & below);
+    }
+    return std::lower_bound(lows.begin(), lows.end(), low) - lows.begin();
+}
+
+uint32_t HybridPostingList::Chunk::GetLow(size_t rank) const {
+    if (!IsBitmap()) {
+        return lows[rank];
+    }
+    // The last word with fewer ids before it than the rank holds the id
+    const size_t word_index = std::upper_bound(ranks.begin(), ranks.end(), rank) - ranks.begin() - 1;
+    uint64_t word = bits[word_index];
+    for (size_t skipped = ranks[word_index]; skipped < rank; ++skipped) {
+        word &= word - 1;
+    }
+    return static_cast<uint32_t>(word_index * 64 + CountTrailingZeros64(word));
+}
+
+uint32_t HybridPostingList::Chunk::NextBit(uint32_t low) const {
+    size_t word_index = low >> 6;
+    if (word_index >= BITMAP_WORDS) {
+        return BITMAP_WORDS * 64;
+    }
+    uint64_t word = bits[word_index] & (~uint64_t{ 0 } << (low & 63));
+    while (word == 0) {
+        if (++word_index == BITMAP_WORDS) {
+            return BITMAP_WORDS * 64;
+        }
+        word = bits[word_index];
+    }
+    return static_cast<uint32_t>(word_index * 64 + CountTrailingZeros64(word));
+}
+
+void HybridPostingList::Chunk::Insert(size_t rank, uint32_t low, double term_freq) {
+    term_freqs.insert(term_freqs.begin() + rank, term_freq);
+    if (IsBitmap()) {
+        bits[low >> 6] |= uint64_t{ 1 } << (low & 63);
+        for (size_t i = (low >> 6) + 1; i < BITMAP_WORDS; ++i) {
+            ++ranks[i];
+        }
+        return;
+    }
+    lows.insert(lows.begin() + rank, static_cast<uint16_t>(low));
+    if (lows.size() > ARRAY_MAX_SIZE) {
+        ToBitmap();
+    }
+}
+
+void HybridPostingList::Chunk::Erase(size_t rank, uint32_t low) {
+    term_freqs.erase(term_freqs.begin() + rank);
+    if (!IsBitmap()) {
+        lows.erase(lows.begin() + rank);
+        return;
+    }
+    bits[low >> 6] &= ~(uint64_t{ 1 } << (low & 63));
+    for (size_t i = (low >> 6) + 1; i < BITMAP_WORDS; ++i) {
+        --ranks[i];
+    }
+    if (size() <= ARRAY_MAX_SIZE) {
+        ToArray();
+    }
+}
+
+void HybridPostingList::Chunk::ToBitmap() {
+    bits.assign(BITMAP_WORDS, 0);
+    for (const uint16_t low : lows) {
+        bits[low >> 6] |= uint64_t{ 1 } << (low & 63);
+    }
+    ComputeRanks();
+    lows.clear();
+    lows.shrink_to_fit();
+}
+
+void HybridPostingList::Chunk::ToArray() {
+    lows.clear();
+    lows.reserve(size());
+    for (size_t word_index = 0; word_index < BITMAP_WORDS; ++word_index) {
+        for (uint64_t word = bits[word_index]; word != 0; word &= word - 1) {
+            lows.push_back(static_cast<uint16_t>(word_index * 64 + CountTrailingZeros64(word)));
+        }
+    }
+    term_freqs.shrink_to_fit();
+    bits.clear();
+    bits.shrink_to_fit();
+    ranks.clear();
+    ranks.shrink_to_fit();
+}
+
+void HybridPostingList::Chunk::ComputeRanks() {
+    ranks.resize(BITMAP_WORDS);
+    size_t count = 0;
+    for (size_t word_index = 0; word_index < BITMAP_WORDS; ++word_index) {
+        ranks[word_index] = static_cast<uint16_t>(count);
+        count += PopCount64(bits[word_index]);
+    }
+}
+
+HybridPostingList::HybridPostingList(const allocator_type& allocator)
+    : chunks_(allocator) {
+}
+
+HybridPostingList::HybridPostingList(const HybridPostingList& other, const allocator_type& allocator)
+    : chunks_(other.chunks_, allocator)
+    , size_(other.size_) {
+}
+
+HybridPostingList::HybridPostingList(HybridPostingList&& other, const allocator_type& allocator)
+    : chunks_(std::move(other.chunks_), allocator)
+    , size_(other.size_) {
+}
+
+size_t HybridPostingList::size() const {
+    return size_;
+}
+
+bool HybridPostingList::empty() const {
+    return size_ == 0;
+}
+
+HybridPostingList::const_iterator HybridPostingList::begin() const {
+    return const_iterator(this, 0, 0);
+}
+
+HybridPostingList::const_iterator HybridPostingList::end() const {
+    return const_iterator(this, chunks_.size(), 0);
+}
+
+size_t HybridPostingList::count(int document_id) const {
+    const size_t chunk = FindChunk(GetKey(document_id));
+    return chunk < chunks_.size() && chunks_[chunk].key == GetKey(document_id)
+        && chunks_[chunk].Contains(GetLow(document_id)) ? 1 : 0;
+}
+
+double& HybridPostingList::operator[](int document_id) {
+    const uint32_t key = GetKey(document_id);
+    const uint32_t low = GetLow(document_id);
+    // Documents are mostly indexed in id order: append to the last chunk
+    if (!chunks_.empty() && chunks_.back().key == key && !chunks_.back().IsBitmap()
+        && chunks_.back().lows.back() < low) {
+        Chunk& chunk = chunks_.back();
+        chunk.Insert(chunk.size(), low, 0.0);
+        ++size_;
+        return chunk.term_freqs.back();
+    }
+    size_t chunk_index = FindChunk(key);
+    if (chunk_index == chunks_.size() || chunks_[chunk_index].key != key) {
+        chunks_.emplace(chunks_.begin() + chunk_index, key);
+    }
+    Chunk& chunk = chunks_[chunk_index];
+    const size_t rank = chunk.Rank(low);
+    if (!chunk.Contains(low)) {
+        chunk.Insert(rank, low, 0.0);
+        ++size_;
+    }
+    return chunk.term_freqs[rank];
+}
+
+double& HybridPostingList::at(int document_id) {
+    return const_cast<double&>(*FindTermFreq(document_id));
+}
+
+double HybridPostingList::at(int document_id) const {
+    return *FindTermFreq(document_id);
+}
+
+const double* HybridPostingList::FindTermFreq(int document_id) const {
+    const uint32_t key = GetKey(document_id);
+    const uint32_t low = GetLow(document_id);
+    const size_t chunk_index = FindChunk(key);
+    if (chunk_index == chunks_.size() || chunks_[chunk_index].key != key || !chunks_[chunk_index].Contains(low)) {
+        throw std::out_of_range("Document "s + std::to_string(document_id) + " has no posting"s);
+    }
+    const Chunk& chunk = chunks_[chunk_index];
+    return &chunk.term_freqs[chunk.Rank(low)];
+}
+
+size_t HybridPostingList::erase(int document_id) {
+    const uint32_t key = GetKey(document_id);
+    const uint32_t low = GetLow(document_id);
+    const size_t chunk_index = FindChunk(key);
+    if (chunk_index == chunks_.size() || chunks_[chunk_index].key != key || !chunks_[chunk_index].Contains(low)) {
+        return 0;
+    }
+    Chunk& chunk = chunks_[chunk_index];
+    chunk.Erase(chunk.Rank(low), low);
+    if (chunk.size() == 0) {
+        chunks_.erase(chunks_.begin() + chunk_index);
+    }
+    --size_;
+    return 1;
+}
+
+void HybridPostingList::EraseSorted(const std::vector<int>& document_ids) {
+    size_t chunk_index = 0;
+    for (auto id_it = document_ids.begin(); id_it != document_ids.end();) {
+        const uint32_t key = GetKey(*id_it);
+        const auto chunk_ids_end = std::find_if(id_it, document_ids.end(), [key](int document_id) {
+            return GetKey(document_id) != key;
+        });
+        chunk_index = FindChunk(key, chunk_index);
+        if (chunk_index == chunks_.size() || chunks_[chunk_index].key != key) {
+            id_it = chunk_ids_end;
+            continue;
+        }
+
+        Chunk& chunk = chunks_[chunk_index];
+        const size_t old_size = chunk.size();
+        if (chunk.IsBitmap()) {
+            // Ranks are taken before any bit is cleared, they come out ascending
+            std::vector<size_t> erased_ranks;
+            for (auto it = id_it; it != chunk_ids_end; ++it) {
+                if (chunk.Contains(GetLow(*it))) {
+                    erased_ranks.push_back(chunk.Rank(GetLow(*it)));
+                }
+            }
+            for (; id_it != chunk_ids_end; ++id_it) {
+                chunk.bits[GetLow(*id_it) >> 6] &= ~(uint64_t{ 1 } << (GetLow(*id_it) & 63));
+            }
+            size_t kept = 0;
+            auto erased_it = erased_ranks.begin();
+            for (size_t rank = 0; rank < chunk.term_freqs.size(); ++rank) {
+                if (erased_it != erased_ranks.end() && *erased_it == rank) {
+                    ++erased_it;
+                    continue;
+                }
+                chunk.term_freqs[kept++] = chunk.term_freqs[rank];
+            }
+            chunk.term_freqs.resize(kept);
+            chunk.ComputeRanks();
+            if (chunk.size() <= ARRAY_MAX_SIZE) {
+                chunk.ToArray();
+            }
+        }
+        else {
+            size_t kept = 0;
+            for (size_t rank = 0; rank < chunk.lows.size(); ++rank) {
+                const uint32_t low = chunk.lows[rank];
+                while (id_it != chunk_ids_end && GetLow(*id_it) < low) {
+                    ++id_it;
+                }
+                if (id_it != chunk_ids_end && GetLow(*id_it) == low) {
+                    continue;
+                }
+                chunk.lows[kept] = chunk.lows[rank];
+                chunk.term_freqs[kept] = chunk.term_freqs[rank];
+                ++kept;
+            }
+            chunk.lows.resize(kept);
+            chunk.term_freqs.resize(kept);
+        }
+        size_ -= old_size - chunk.size();
+        if (chunk.size() == 0) {
+            chunks_.erase(chunks_.begin() + chunk_index);
+        }
+        id_it = chunk_ids_end;
+    }
+}
+
+void HybridPostingList::SkipTo(const_iterator& cursor, int document_id) const {
+    if (cursor.chunk_ == chunks_.size() || (*cursor).first >= document_id) {
+        return;
+    }
+    const uint32_t key = GetKey(document_id);
+    size_t chunk_index = cursor.chunk_;
+    size_t first_rank = cursor.rank_;
+    if (chunks_[chunk_index].key < key) {
+        chunk_index = FindChunk(key, chunk_index + 1);
+        first_rank = 0;
+        if (chunk_index == chunks_.size() || chunks_[chunk_index].key > key) {
+            cursor = const_iterator(this, chunk_index, 0);
+            return;
+        }
+    }
+    const Chunk& chunk = chunks_[chunk_index];
+    const uint32_t low = GetLow(document_id);
+    if (chunk.IsBitmap()) {
+        const uint32_t next = chunk.NextBit(low);
+        if (next == Chunk::BITMAP_WORDS * 64) {
+            cursor = const_iterator(this, chunk_index + 1, 0);
+            return;
+        }
+        cursor.chunk_ = chunk_index;
+        cursor.rank_ = chunk.Rank(next);
+        cursor.low_ = next;
+        return;
+    }
+    const size_t rank = std::lower_bound(chunk.lows.begin() + first_rank, chunk.lows.end(), low) - chunk.lows.begin();
+    cursor = rank == chunk.size() ? const_iterator(this, chunk_index + 1, 0) : const_iterator(this, chunk_index, rank);
+}
+
+void HybridPostingList::AddTo(DocumentBitset& documents) const {
+    for (const Chunk& chunk : chunks_) {
+        const size_t base = size_t{ chunk.key } << CHUNK_BITS;
+        if (!chunk.IsBitmap()) {
+            for (const uint16_t low : chunk.lows) {
+                documents.Set(base + low);
+            }
+            continue;
+        }
+        if (documents.Size() < base + Chunk::BITMAP_WORDS * 64) {
+            documents.Resize(base + Chunk::BITMAP_WORDS * 64);
+        }
+        std::vector<uint64_t>& words = documents.GetWords();
+        for (size_t i = 0; i < Chunk::BITMAP_WORDS; ++i) {
+            words[base / 64 + i] |= chunk.bits[i];
+        }
+    }
+}
+
+std::vector<int> HybridPostingList::SampleIds(size_t step) const {
+    std::vector<int> ids;
+    ids.reserve(size_ / step);
+    size_t chunk_begin = 0;
+    size_t position = step;
+    for (const Chunk& chunk : chunks_) {
+        for (; position < chunk_begin + chunk.size(); position += step) {
+            ids.push_back(static_cast<int>(chunk.key << CHUNK_BITS | chunk.GetLow(position - chunk_begin)));
+        }
+        chunk_begin += chunk.size();
+    }
+    return ids;
+}
+
+size_t HybridPostingList::GetMemoryUsage() const {
+    size_t memory = chunks_.capacity() * sizeof(Chunk);
+    for (const Chunk& chunk : chunks_) {
+        memory += chunk.lows.capacity() * sizeof(uint16_t) + chunk.bits.capacity() * sizeof(uint64_t)
+            + chunk.ranks.capacity() * sizeof(uint16_t) + chunk.term_freqs.capacity() * sizeof(double);
+    }
+    return memory;
+}
+
+uint32_t HybridPostingList::GetKey(int document_id) {
+    return static_cast<uint32_t>(document_id) >> CHUNK_BITS;
+}
+
+uint32_t HybridPostingList::GetLow(int document_id) {
+    return static_cast<uint32_t>(document_id) & ((uint32_t{ 1 } << CHUNK_BITS) - 1);
+}
+
+size_t HybridPostingList::FindChunk(uint32_t key, size_t first) const {
+    return std::lower_bound(chunks_.begin() + first, chunks_.end(), key, [](const Chunk& chunk, uint32_t key) {
+        return chunk.key < key;
+    }) - chunks_.begin();
+}
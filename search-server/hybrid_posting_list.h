@@ -0,0 +1,187 @@
+#pragma once
+#include "document_bitset.h"
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+// Posting list of a term: ascending document ids, which the server takes
+// from its dense slots, with their term frequencies, split roaring-style
+// into chunks of 2^16 ids by the high bits. A chunk keeps the low bits of
+// its ids in a sorted array while it holds up to ARRAY_MAX_SIZE of them and
+// in a bitmap once it is denser, so membership in a dense chunk is a single
+// bit probe. Term frequencies are kept in a side array in id order.
+class HybridPostingList {
+private:
+    struct Chunk;
+
+public:
+    using allocator_type = std::pmr::polymorphic_allocator<std::byte>;
+    using value_type = std::pair<int, double>;
+
+    static constexpr int CHUNK_BITS = 16;
+    static constexpr size_t ARRAY_MAX_SIZE = 4096;
+
+    class const_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = HybridPostingList::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = value_type;
+
+        struct ArrowProxy {
+            value_type value;
+
+            const value_type* operator->() const {
+                return &value;
+            }
+        };
+
+        const_iterator() = default;
+
+        value_type operator*() const;
+        ArrowProxy operator->() const;
+        const_iterator& operator++();
+
+        bool operator==(const const_iterator& other) const {
+            return chunk_ == other.chunk_ && rank_ == other.rank_;
+        }
+
+        bool operator!=(const const_iterator& other) const {
+            return !(*this == other);
+        }
+
+    private:
+        friend class HybridPostingList;
+
+        const HybridPostingList* list_ = nullptr;
+        size_t chunk_ = 0;
+        // Position within the chunk
+        size_t rank_ = 0;
+        // Low bits of the current id
+        uint32_t low_ = 0;
+
+        const_iterator(const HybridPostingList* list, size_t chunk, size_t rank);
+    };
+
+    explicit HybridPostingList(const allocator_type& allocator = {});
+    HybridPostingList(const HybridPostingList& other, const allocator_type& allocator);
+    HybridPostingList(HybridPostingList&& other, const allocator_type& allocator);
+    HybridPostingList(const HybridPostingList&) = default;
+    HybridPostingList(HybridPostingList&&) = default;
+    HybridPostingList& operator=(const HybridPostingList&) = default;
+    HybridPostingList& operator=(HybridPostingList&&) = default;
+
+    size_t size() const;
+    bool empty() const;
+    const_iterator begin() const;
+    const_iterator end() const;
+
+    size_t count(int document_id) const;
+    // Term frequency of the document, a new posting starts at 0
+    double& operator[](int document_id);
+    // Throws out_of_range for a missing document
+    double& at(int document_id);
+    double at(int document_id) const;
+    size_t erase(int document_id);
+    // Removes the postings of the sorted ids in one pass over the affected chunks
+    void EraseSorted(const std::vector<int>& document_ids);
+
+    // Moves the cursor forward to the first posting with an id not less than
+    // the document id: a search within the chunk, a bit probe for a bitmap
+    void SkipTo(const_iterator& cursor, int document_id) const;
+    // Sets the bits of the documents, a word at a time for bitmap chunks
+    void AddTo(DocumentBitset& documents) const;
+    // Ids at positions step, 2 * step, ... located through the chunk sizes
+    // without visiting the postings in between. The step must be positive.
+    std::vector<int> SampleIds(size_t step) const;
+
+    size_t GetMemoryUsage() const;
+
+private:
+    struct Chunk {
+        using allocator_type = std::pmr::polymorphic_allocator<std::byte>;
+
+        static constexpr size_t BITMAP_WORDS = (size_t{ 1 } << CHUNK_BITS) / 64;
+
+        uint32_t key;
+        // Array container: sorted low bits of the ids
+        std::pmr::vector<uint16_t> lows;
+        // Bitmap container: a bit per id and the count of ids before every word
+        std::pmr::vector<uint64_t> bits;
+        std::pmr::vector<uint16_t> ranks;
+        std::pmr::vector<double> term_freqs;
+
+        Chunk(uint32_t key, const allocator_type& allocator);
+        Chunk(const Chunk& other, const allocator_type& allocator);
+        Chunk(Chunk&& other, const allocator_type& allocator);
+        Chunk(const Chunk&) = default;
+        Chunk(Chunk&&) = default;
+        Chunk& operator=(const Chunk&) = default;
+        Chunk& operator=(Chunk&&) = default;
+
+        bool IsBitmap() const {
+            return !bits.empty();
+        }
+
+        size_t size() const {
+            return term_freqs.size();
+        }
+
+        bool Contains(uint32_t low) const;
+        // Number of ids below low, which is also the position of the first id not less than low
+        size_t Rank(uint32_t low) const;
+        uint32_t GetLow(size_t rank) const;
+        // First id of a bitmap not less than low, 2^16 when there is none
+        uint32_t NextBit(uint32_t low) const;
+
+        // The id must be absent
+        void Insert(size_t rank, uint32_t low, double term_freq);
+        void Erase(size_t rank, uint32_t low);
+        void ToBitmap();
+        void ToArray();
+        void ComputeRanks();
+    };
+
+    std::pmr::vector<Chunk> chunks_;
+    size_t size_ = 0;
+
+    static uint32_t GetKey(int document_id);
+    static uint32_t GetLow(int document_id);
+    // Position of the first chunk with a key not less than the given one
+    size_t FindChunk(uint32_t key, size_t first = 0) const;
+    // Null when the document is absent
+    const double* FindTermFreq(int document_id) const;
+};
+
+inline HybridPostingList::const_iterator::const_iterator(const HybridPostingList* list, size_t chunk, size_t rank)
+    : list_(list)
+    , chunk_(chunk)
+    , rank_(rank) {
+    if (chunk_ < list_->chunks_.size()) {
+        low_ = list_->chunks_[chunk_].GetLow(rank_);
+    }
+}
+
+inline HybridPostingList::const_iterator::value_type HybridPostingList::const_iterator::operator*() const {
+    const Chunk& chunk = list_->chunks_[chunk_];
+    return { static_cast<int>(chunk.key << CHUNK_BITS | low_), chunk.term_freqs[rank_] };
+}
+
+inline HybridPostingList::const_iterator::ArrowProxy HybridPostingList::const_iterator::operator->() const {
+    return { **this };
+}
+
+inline HybridPostingList::const_iterator& HybridPostingList::const_iterator::operator++() {
+    const Chunk& chunk = list_->chunks_[chunk_];
+    if (++rank_ < chunk.size()) {
+        low_ = chunk.IsBitmap() ? chunk.NextBit(low_ + 1) : chunk.lows[rank_];
+    }
+    else {
+        *this = const_iterator(list_, chunk_ + 1, 0);
+    }
+    return *this;
+}
@@ -0,0 +1,54 @@
+#include "impact_ordered_postings.h"
+#include <algorithm>
+#include <utility>
+
+ImpactOrderedPostings::ImpactOrderedPostings(std::vector<Posting> postings)
+    : postings_(std::move(postings)) {
+    std::sort(postings_.begin(), postings_.end(), [](const Posting& lhs, const Posting& rhs) {
+        return lhs.term_freq > rhs.term_freq || (lhs.term_freq == rhs.term_freq && lhs.slot < rhs.slot);
+    });
+    if (postings_.empty()) {
+        return;
+    }
+    const double level_scale = (IMPACT_LEVELS - 1) / static_cast<double>(postings_.front().term_freq);
+    const auto get_level = [level_scale](const Posting& posting) {
+        return static_cast<int>(posting.term_freq * level_scale);
+    };
+    for (size_t begin = 0; begin < postings_.size();) {
+        const int level = get_level(postings_[begin]);
+        size_t end = begin + 1;
+        while (end < postings_.size() && get_level(postings_[end]) == level) {
+            ++end;
+        }
+        blocks_.push_back({ postings_[begin].term_freq, static_cast<uint32_t>(end) });
+        std::sort(postings_.begin() + begin, postings_.begin() + end, [](const Posting& lhs, const Posting& rhs) {
+            return lhs.slot < rhs.slot;
+        });
+        begin = end;
+    }
+    blocks_.shrink_to_fit();
+}
+
+size_t ImpactOrderedPostings::size() const {
+    return postings_.size();
+}
+
+size_t ImpactOrderedPostings::GetBlockCount() const {
+    return blocks_.size();
+}
+
+double ImpactOrderedPostings::GetBlockImpact(size_t block) const {
+    return blocks_[block].max_term_freq;
+}
+
+const ImpactOrderedPostings::Posting* ImpactOrderedPostings::GetBlockBegin(size_t block) const {
+    return postings_.data() + (block == 0 ? 0 : blocks_[block - 1].end);
+}
+
+const ImpactOrderedPostings::Posting* ImpactOrderedPostings::GetBlockEnd(size_t block) const {
+    return postings_.data() + blocks_[block].end;
+}
+
+size_t ImpactOrderedPostings::GetMemoryUsage() const {
+    return blocks_.capacity() * sizeof(BlockHeader) + postings_.capacity() * sizeof(Posting);
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Read-only posting list ordered by impact for score-at-a-time evaluation.
+// Postings are sorted by term frequency, highest first, and cut into blocks
+// whose term frequencies quantize to the same one of IMPACT_LEVELS levels of
+// the largest one. Inside a block postings are ordered by slot, so
+// the scores are updated in address order.
+class ImpactOrderedPostings {
+public:
+    static constexpr int IMPACT_LEVELS = 256;
+
+    struct Posting {
+        // Slot of the document in the server's DocumentAttributes
+        int slot;
+        float term_freq;
+    };
+
+    ImpactOrderedPostings() = default;
+    explicit ImpactOrderedPostings(std::vector<Posting> postings);
+
+    size_t size() const;
+    size_t GetBlockCount() const;
+    // Largest term frequency of the block, not less than any later block's
+    double GetBlockImpact(size_t block) const;
+    const Posting* GetBlockBegin(size_t block) const;
+    const Posting* GetBlockEnd(size_t block) const;
+    size_t GetMemoryUsage() const;
+
+private:
+    struct BlockHeader {
+        float max_term_freq;
+        uint32_t end;
+    };
+
+    std::vector<BlockHeader> blocks_;
+    std::vector<Posting> postings_;
+};
@@ -0,0 +1,264 @@
+#include "index_segment.h"
+
+void MutableSegment::AddDocument(const SegmentDocument& document, const std::vector<std::string_view>& words) {
+    DocumentEntry& entry = documents_[document.id];
+    entry.data = document;
+    const double inv_word_count = 1.0 / words.size();
+    for (std::string_view word : words) {
+        auto it = word_to_document_freqs_.find(word);
+        if (it == word_to_document_freqs_.end()) {
+            it = word_to_document_freqs_.emplace(std::string(word), std::map<int, double>{}).first;
+        }
+        double& term_freq = it->second[document.id];
+        if (term_freq == 0) {
+            entry.words.push_back(it->first);
+        }
+        term_freq += inv_word_count;
+    }
+}
+
+bool MutableSegment::RemoveDocument(int document_id) {
+    const auto it = documents_.find(document_id);
+    if (it == documents_.end()) {
+        return false;
+    }
+    for (std::string_view word : it->second.words) {
+        const auto word_it = word_to_document_freqs_.find(word);
+        word_it->second.erase(document_id);
+        if (word_it->second.empty()) {
+            word_to_document_freqs_.erase(word_it);
+        }
+    }
+    documents_.erase(it);
+    return true;
+}
+
+size_t MutableSegment::GetDocumentCount() const {
+    return documents_.size();
+}
+
+const std::map<int, double>* MutableSegment::FindPostings(std::string_view word) const {
+    const auto it = word_to_document_freqs_.find(word);
+    return it == word_to_document_freqs_.end() ? nullptr : &it->second;
+}
+
+MutableSegment::Cursor MutableSegment::GetCursor(std::string_view word) const {
+    return Cursor(FindPostings(word));
+}
+
+size_t MutableSegment::GetPostingCount(std::string_view word) const {
+    const auto* postings = FindPostings(word);
+    return postings == nullptr ? 0 : postings->size();
+}
+
+size_t MutableSegment::CountLivePostings(std::string_view word) const {
+    // Removal erases the postings here
+    return GetPostingCount(word);
+}
+
+const SegmentDocument& MutableSegment::GetDocument(uint32_t document) const {
+    return documents_.at(static_cast<int>(document)).data;
+}
+
+MutableSegment::Cursor::Cursor(const std::map<int, double>* postings)
+    : postings_(postings) {
+    if (postings_ != nullptr) {
+        it_ = postings_->begin();
+    }
+}
+
+bool MutableSegment::Cursor::AtEnd() const {
+    return postings_ == nullptr || it_ == postings_->end();
+}
+
+uint32_t MutableSegment::Cursor::GetDocument() const {
+    return static_cast<uint32_t>(it_->first);
+}
+
+double MutableSegment::Cursor::GetTermFreq() const {
+    return it_->second;
+}
+
+void MutableSegment::Cursor::Next() {
+    ++it_;
+}
+
+void MutableSegment::Cursor::SkipTo(uint32_t target) {
+    if (!AtEnd() && GetDocument() < target) {
+        it_ = postings_->lower_bound(static_cast<int>(target));
+    }
+}
+
+std::shared_ptr<ImmutableSegment> ImmutableSegment::Seal(const MutableSegment& segment, TermFreqEncoding encoding) {
+    std::vector<SegmentDocument> documents;
+    documents.reserve(segment.documents_.size());
+    for (const auto& [_, entry] : segment.documents_) {
+        documents.push_back(entry.data);
+    }
+    PostingMap postings;
+    for (const auto& [word, document_freqs] : segment.word_to_document_freqs_) {
+        postings[word].assign(document_freqs.begin(), document_freqs.end());
+    }
+    return Build(std::move(documents), postings, encoding);
+}
+
+std::shared_ptr<ImmutableSegment> ImmutableSegment::Merge(const std::vector<std::shared_ptr<ImmutableSegment>>& segments,
+    const std::vector<DocumentBitset>& tombstones, TermFreqEncoding encoding) {
+    std::vector<SegmentDocument> documents;
+    PostingMap postings;
+    for (size_t s = 0; s < segments.size(); ++s) {
+        const ImmutableSegment& segment = *segments[s];
+        for (size_t local = 0; local < segment.document_ids_.size(); ++local) {
+            if (!tombstones[s].Test(local)) {
+                documents.push_back({ segment.document_ids_[local], segment.ratings_[local], segment.statuses_[local] });
+            }
+        }
+        for (size_t term = 0; term + 1 < segment.term_offsets_.size(); ++term) {
+            std::vector<std::pair<int, double>>* merged = nullptr;
+            segment.postings_[term].ForEach([&](uint32_t local, double term_freq) {
+                if (tombstones[s].Test(local)) {
+                    return;
+                }
+                if (merged == nullptr) {
+                    merged = &postings[segment.GetTerm(term)];
+                }
+                merged->emplace_back(segment.document_ids_[local], term_freq);
+                });
+        }
+    }
+    return Build(std::move(documents), postings, encoding);
+}
+
+std::shared_ptr<ImmutableSegment> ImmutableSegment::Build(std::vector<SegmentDocument> documents, const PostingMap& postings,
+    TermFreqEncoding encoding) {
+    auto segment = std::make_shared<ImmutableSegment>();
+    std::sort(documents.begin(), documents.end(), [](const SegmentDocument& lhs, const SegmentDocument& rhs) {
+        return lhs.id < rhs.id;
+        });
+    segment->document_ids_.reserve(documents.size());
+    segment->ratings_.reserve(documents.size());
+    segment->statuses_.reserve(documents.size());
+    for (const SegmentDocument& document : documents) {
+        segment->document_ids_.push_back(document.id);
+        segment->ratings_.push_back(document.rating);
+        segment->statuses_.push_back(document.status);
+    }
+    segment->tombstones_.Resize(documents.size());
+    segment->live_document_count_ = documents.size();
+
+    segment->term_offsets_.reserve(postings.size() + 1);
+    segment->postings_.reserve(postings.size());
+    std::vector<std::pair<int, double>> term_postings;
+    std::vector<std::pair<uint32_t, double>> local_postings;
+    for (const auto& [word, document_freqs] : postings) {
+        segment->term_offsets_.push_back(segment->term_data_.size());
+        segment->term_data_.append(word);
+
+        term_postings = document_freqs;
+        std::sort(term_postings.begin(), term_postings.end());
+        local_postings.clear();
+        for (const auto& [document_id, term_freq] : term_postings) {
+            const auto it = std::lower_bound(segment->document_ids_.begin(), segment->document_ids_.end(), document_id);
+            local_postings.emplace_back(it - segment->document_ids_.begin(), term_freq);
+        }
+        segment->postings_.emplace_back(local_postings, encoding);
+    }
+    segment->term_offsets_.push_back(segment->term_data_.size());
+    segment->term_data_.shrink_to_fit();
+    return segment;
+}
+
+size_t ImmutableSegment::GetDocumentCount() const {
+    return document_ids_.size();
+}
+
+size_t ImmutableSegment::GetLiveDocumentCount() const {
+    return live_document_count_;
+}
+
+int ImmutableSegment::GetDocumentId(size_t local_document) const {
+    return document_ids_[local_document];
+}
+
+const DocumentBitset& ImmutableSegment::GetTombstones() const {
+    return tombstones_;
+}
+
+size_t ImmutableSegment::GetMemoryUsage() const {
+    size_t result = sizeof(*this) + term_data_.capacity() + term_offsets_.capacity() * sizeof(uint32_t)
+        + document_ids_.capacity() * sizeof(int) + ratings_.capacity() * sizeof(int)
+        + statuses_.capacity() * sizeof(DocumentStatus) + tombstones_.GetWords().capacity() * sizeof(uint64_t);
+    for (const CompressedPostingList& postings : postings_) {
+        result += postings.GetMemoryUsage();
+    }
+    return result;
+}
+
+bool ImmutableSegment::RemoveDocument(int document_id) {
+    const auto it = std::lower_bound(document_ids_.begin(), document_ids_.end(), document_id);
+    if (it == document_ids_.end() || *it != document_id) {
+        return false;
+    }
+    const size_t local = it - document_ids_.begin();
+    if (tombstones_.Test(local)) {
+        return false;
+    }
+    tombstones_.Set(local);
+    --live_document_count_;
+    return true;
+}
+
+ImmutableSegment::Cursor ImmutableSegment::GetCursor(std::string_view word) const {
+    static const CompressedPostingList empty_postings;
+    const size_t term_index = FindTerm(word);
+    return Cursor(term_index == postings_.size() ? empty_postings : postings_[term_index]);
+}
+
+size_t ImmutableSegment::GetPostingCount(std::string_view word) const {
+    const size_t term_index = FindTerm(word);
+    return term_index == postings_.size() ? 0 : postings_[term_index].size();
+}
+
+size_t ImmutableSegment::CountLivePostings(std::string_view word) const {
+    const size_t term_index = FindTerm(word);
+    if (term_index == postings_.size()) {
+        return 0;
+    }
+    size_t count = postings_[term_index].size();
+    if (live_document_count_ == document_ids_.size()) {
+        return count;
+    }
+    Cursor cursor(postings_[term_index]);
+    tombstones_.ForEach([&cursor, &count](size_t local_document) {
+        cursor.SkipTo(static_cast<uint32_t>(local_document));
+        if (!cursor.AtEnd() && cursor.GetDocument() == local_document) {
+            --count;
+        }
+        });
+    return count;
+}
+
+SegmentDocument ImmutableSegment::GetDocument(uint32_t local_document) const {
+    return { document_ids_[local_document], ratings_[local_document], statuses_[local_document] };
+}
+
+std::string_view ImmutableSegment::GetTerm(size_t term_index) const {
+    return std::string_view(term_data_).substr(term_offsets_[term_index],
+        term_offsets_[term_index + 1] - term_offsets_[term_index]);
+}
+
+size_t ImmutableSegment::FindTerm(std::string_view word) const {
+    const size_t term_count = term_offsets_.size() - 1;
+    size_t left = 0;
+    size_t right = term_count;
+    while (left < right) {
+        const size_t middle = left + (right - left) / 2;
+        if (GetTerm(middle) < word) {
+            left = middle + 1;
+        }
+        else {
+            right = middle;
+        }
+    }
+    return left < term_count && GetTerm(left) == word ? left : term_count;
+}
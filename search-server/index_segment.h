@@ -0,0 +1,121 @@
+#pragma once
+#include "compressed_posting_list.h"
+#include "document.h"
+#include "document_bitset.h"
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct SegmentDocument {
+    int id = 0;
+    int rating = 0;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+};
+
+// Both segment kinds are read through the same interface: a Cursor over the
+// postings of a word in ascending document number with Next and SkipTo,
+// IsLive and GetDocument for a document number, and the posting counts.
+// Document numbers are ids in the mutable segment and local numbers in the
+// immutable ones, whose local order is the id order.
+
+// Small write-optimized segment that receives new documents
+class MutableSegment {
+public:
+    class Cursor {
+    public:
+        explicit Cursor(const std::map<int, double>* postings);
+
+        bool AtEnd() const;
+        uint32_t GetDocument() const;
+        double GetTermFreq() const;
+
+        void Next();
+        void SkipTo(uint32_t target);
+
+    private:
+        const std::map<int, double>* postings_;
+        std::map<int, double>::const_iterator it_;
+    };
+
+    void AddDocument(const SegmentDocument& document, const std::vector<std::string_view>& words);
+    bool RemoveDocument(int document_id);
+    size_t GetDocumentCount() const;
+
+    Cursor GetCursor(std::string_view word) const;
+    size_t GetPostingCount(std::string_view word) const;
+    size_t CountLivePostings(std::string_view word) const;
+    bool IsLive(uint32_t) const {
+        return true;
+    }
+    const SegmentDocument& GetDocument(uint32_t document) const;
+
+private:
+    struct DocumentEntry {
+        SegmentDocument data;
+        std::vector<std::string_view> words;
+    };
+
+    std::map<std::string, std::map<int, double>, std::less<>> word_to_document_freqs_;
+    std::map<int, DocumentEntry> documents_;
+
+    // Null when the word is absent
+    const std::map<int, double>* FindPostings(std::string_view word) const;
+
+    friend class ImmutableSegment;
+};
+
+// Read-optimized segment: sorted term dictionary and compressed posting lists
+// that address documents by their local number. Only the tombstones change
+// after the segment is built.
+class ImmutableSegment {
+public:
+    using Cursor = CompressedPostingList::Cursor;
+
+    static std::shared_ptr<ImmutableSegment> Seal(const MutableSegment& segment, TermFreqEncoding encoding);
+    // Drops the documents marked in the tombstone snapshots
+    static std::shared_ptr<ImmutableSegment> Merge(const std::vector<std::shared_ptr<ImmutableSegment>>& segments,
+        const std::vector<DocumentBitset>& tombstones, TermFreqEncoding encoding);
+
+    size_t GetDocumentCount() const;
+    size_t GetLiveDocumentCount() const;
+    int GetDocumentId(size_t local_document) const;
+    const DocumentBitset& GetTombstones() const;
+    size_t GetMemoryUsage() const;
+
+    bool RemoveDocument(int document_id);
+
+    // Decodes nothing but the first block, the blocks are decoded as the cursor reaches them
+    Cursor GetCursor(std::string_view word) const;
+    // Postings including the ones of removed documents
+    size_t GetPostingCount(std::string_view word) const;
+    // Postings of live documents: the tombstones are looked up in the list
+    // by skipping, not by decoding it whole
+    size_t CountLivePostings(std::string_view word) const;
+    bool IsLive(uint32_t local_document) const {
+        return !tombstones_.Test(local_document);
+    }
+    SegmentDocument GetDocument(uint32_t local_document) const;
+
+private:
+    using PostingMap = std::map<std::string_view, std::vector<std::pair<int, double>>>;
+
+    std::string term_data_;
+    std::vector<uint32_t> term_offsets_;
+    std::vector<CompressedPostingList> postings_;
+    std::vector<int> document_ids_;
+    std::vector<int> ratings_;
+    std::vector<DocumentStatus> statuses_;
+    DocumentBitset tombstones_;
+    size_t live_document_count_ = 0;
+
+    static std::shared_ptr<ImmutableSegment> Build(std::vector<SegmentDocument> documents, const PostingMap& postings,
+        TermFreqEncoding encoding);
+
+    std::string_view GetTerm(size_t term_index) const;
+    // Returns the number of terms when the word is absent
+    size_t FindTerm(std::string_view word) const;
+};
@@ -0,0 +1,362 @@
+#include "ingestion.h"
+#include "bounded_queue.h"
+#include "mapped_file.h"
+#include <charconv>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+using namespace std::string_literals;
+using namespace std::string_view_literals;
+
+namespace {
+
+struct Chunk {
+    std::shared_ptr<const void> owner;
+    std::string_view text;
+};
+
+struct AnalyzedDocument {
+    int id = 0;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+    std::vector<std::pair<std::string_view, double>> term_freqs;
+};
+
+struct AnalyzedBatch {
+    std::shared_ptr<const void> owner;
+    std::vector<AnalyzedDocument> documents;
+    size_t rejected = 0;
+};
+
+struct DocumentLine {
+    int id = 0;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+    std::string_view text;
+};
+
+// Cuts the next tab-separated field off the line
+std::string_view TakeField(std::string_view& line) {
+    const size_t tab = line.find('\t');
+    const std::string_view field = line.substr(0, tab);
+    line.remove_prefix(tab == line.npos ? line.size() : tab + 1);
+    return field;
+}
+
+bool ParseInt(std::string_view text, int& value) {
+    const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return error == std::errc() && end == text.data() + text.size();
+}
+
+bool ParseStatus(std::string_view text, DocumentStatus& status) {
+    if (text == "ACTUAL"sv) {
+        status = DocumentStatus::ACTUAL;
+    }
+    else if (text == "IRRELEVANT"sv) {
+        status = DocumentStatus::IRRELEVANT;
+    }
+    else if (text == "BANNED"sv) {
+        status = DocumentStatus::BANNED;
+    }
+    else if (text == "REMOVED"sv) {
+        status = DocumentStatus::REMOVED;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+bool ParseDocumentLine(std::string_view line, DocumentLine& document) {
+    if (!ParseInt(TakeField(line), document.id) || !ParseStatus(TakeField(line), document.status)) {
+        return false;
+    }
+    std::string_view ratings = TakeField(line);
+    document.ratings.clear();
+    while (!ratings.empty()) {
+        const size_t space = ratings.find(' ');
+        const std::string_view rating = ratings.substr(0, space);
+        ratings.remove_prefix(space == ratings.npos ? ratings.size() : space + 1);
+        if (rating.empty()) {
+            continue;
+        }
+        int value;
+        if (!ParseInt(rating, value)) {
+            return false;
+        }
+        document.ratings.push_back(value);
+    }
+    document.text = line;
+    return true;
+}
+
+// Calls function(line) for every non-empty line, without the line break
+template <typename Function>
+void ForEachLine(std::string_view text, Function function) {
+    while (!text.empty()) {
+        const size_t end = text.find('\n');
+        std::string_view line = text.substr(0, end);
+        text.remove_prefix(end == text.npos ? text.size() : end + 1);
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        if (!line.empty()) {
+            function(line);
+        }
+    }
+}
+
+AnalyzedBatch AnalyzeChunk(const SearchServer& search_server, Chunk chunk) {
+    AnalyzedBatch batch;
+    // A mapped file is read-only, documents to normalize are copied once per chunk
+    std::shared_ptr<std::string> copy;
+    if (search_server.GetTextAnalysis().fold_case) {
+        copy = std::make_shared<std::string>(chunk.text);
+        chunk.text = *copy;
+        chunk.owner = copy;
+    }
+    DocumentLine line_document;
+    ForEachLine(chunk.text, [&](std::string_view line) {
+        if (!ParseDocumentLine(line, line_document)) {
+            ++batch.rejected;
+            return;
+        }
+        if (copy != nullptr) {
+            CaseFoldNormalizer::Normalize(copy->data() + (line_document.text.data() - copy->data()),
+                line_document.text.size());
+        }
+        try {
+            batch.documents.push_back({ line_document.id, line_document.status, line_document.ratings,
+                search_server.ComputeTermFrequencies(line_document.text) });
+        }
+        catch (const std::invalid_argument&) {
+            ++batch.rejected;
+        }
+        });
+    batch.owner = std::move(chunk.owner);
+    return batch;
+}
+
+class Pipeline {
+public:
+    Pipeline(SearchServer& search_server, const IngestionOptions& options)
+        : search_server_(search_server)
+        , chunks_(options.queue_capacity)
+        , batches_(options.queue_capacity)
+        , worker_count_(options.worker_count != 0 ? options.worker_count
+            : std::max(2u, std::thread::hardware_concurrency()) - 1) {
+    }
+
+    // read_chunk(chunk) returns false at the end of the input
+    IngestionStats Run(const std::function<bool(Chunk&)>& read_chunk) {
+        const auto start_time = std::chrono::steady_clock::now();
+        running_workers_ = worker_count_;
+        std::thread reader([this, &read_chunk] {
+            Guard([&] {
+                Chunk chunk;
+                while (read_chunk(chunk)) {
+                    stats_.bytes_read += chunk.text.size();
+                    stats_.reader_stalls += Push(chunks_, chunk);
+                }
+                });
+            reader_done_.store(true, std::memory_order_release);
+            });
+        std::vector<std::thread> workers;
+        workers.reserve(worker_count_);
+        for (size_t i = 0; i < worker_count_; ++i) {
+            workers.emplace_back([this] {
+                Guard([this] {
+                    Chunk chunk;
+                    while (Pop(chunks_, chunk, [this] { return reader_done_.load(std::memory_order_acquire); })) {
+                        AnalyzedBatch batch = AnalyzeChunk(search_server_, std::move(chunk));
+                        Push(batches_, batch);
+                    }
+                    });
+                running_workers_.fetch_sub(1, std::memory_order_release);
+                });
+        }
+
+        Guard([this] {
+            const auto workers_done = [this] {
+                return running_workers_.load(std::memory_order_acquire) == 0;
+            };
+            AnalyzedBatch batch;
+            while (true) {
+                if (!batches_.TryPop(batch)) {
+                    if (!Pop(batches_, batch, workers_done)) {
+                        break;
+                    }
+                    ++stats_.merge_stalls;
+                }
+                Merge(batch);
+            }
+            });
+
+        reader.join();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+        stats_.elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start_time);
+        return stats_;
+    }
+
+private:
+    SearchServer& search_server_;
+    BoundedQueue<Chunk> chunks_;
+    BoundedQueue<AnalyzedBatch> batches_;
+    const size_t worker_count_;
+    std::atomic<bool> reader_done_ = false;
+    std::atomic<size_t> running_workers_ = 0;
+    std::atomic<bool> aborted_ = false;
+    std::mutex error_mutex_;
+    std::exception_ptr error_;
+    IngestionStats stats_;
+
+    // Runs a stage, an exception stops the whole pipeline and is rethrown by Run
+    template <typename Function>
+    void Guard(Function function) {
+        try {
+            function();
+        }
+        catch (...) {
+            std::lock_guard guard(error_mutex_);
+            if (!error_) {
+                error_ = std::current_exception();
+            }
+            aborted_.store(true, std::memory_order_relaxed);
+        }
+    }
+
+    // Returns whether the queue was full at first
+    template <typename T>
+    bool Push(BoundedQueue<T>& queue, T& value) {
+        if (queue.TryPush(value)) {
+            return false;
+        }
+        while (!queue.TryPush(value)) {
+            if (aborted_.load(std::memory_order_relaxed)) {
+                throw std::runtime_error("Ingestion aborted"s);
+            }
+            std::this_thread::yield();
+        }
+        return true;
+    }
+
+    // Waits for a value, returns false once the producers are done and the
+    // queue is empty
+    template <typename T, typename ProducersDone>
+    bool Pop(BoundedQueue<T>& queue, T& value, ProducersDone producers_done) {
+        while (!queue.TryPop(value)) {
+            // The producers push before they report being done
+            if (producers_done()) {
+                return queue.TryPop(value);
+            }
+            if (aborted_.load(std::memory_order_relaxed)) {
+                return false;
+            }
+            std::this_thread::yield();
+        }
+        return true;
+    }
+
+    void Merge(const AnalyzedBatch& batch) {
+        stats_.documents_rejected += batch.rejected;
+        for (const AnalyzedDocument& document : batch.documents) {
+            try {
+                search_server_.AddAnalyzedDocument(document.id, document.term_freqs, document.status,
+                    document.ratings, batch.owner);
+                ++stats_.documents_indexed;
+            }
+            catch (const std::invalid_argument&) {
+                ++stats_.documents_rejected;
+            }
+        }
+    }
+};
+
+void CheckOptions(const IngestionOptions& options) {
+    if (options.chunk_size == 0) {
+        throw std::invalid_argument("Ingestion chunk size must be positive"s);
+    }
+}
+
+}  // namespace
+
+double IngestionStats::GetMegabytesPerSecond() const {
+    const double seconds = std::chrono::duration<double>(elapsed).count();
+    return seconds > 0 ? bytes_read / (1024.0 * 1024.0) / seconds : 0.0;
+}
+
+double IngestionStats::GetDocumentsPerSecond() const {
+    const double seconds = std::chrono::duration<double>(elapsed).count();
+    return seconds > 0 ? documents_indexed / seconds : 0.0;
+}
+
+std::ostream& operator<<(std::ostream& out, const IngestionStats& stats) {
+    out << "documents = "s << stats.documents_indexed
+        << ", rejected = "s << stats.documents_rejected
+        << ", bytes = "s << stats.bytes_read
+        << ", elapsed = "s << std::chrono::duration_cast<std::chrono::milliseconds>(stats.elapsed).count() << " ms"s
+        << ", "s << stats.GetMegabytesPerSecond() << " MB/s"s
+        << ", "s << stats.GetDocumentsPerSecond() << " documents/s"s
+        << ", reader stalls = "s << stats.reader_stalls
+        << ", merge stalls = "s << stats.merge_stalls;
+    return out;
+}
+
+IngestionStats IngestDocuments(SearchServer& search_server, const std::string& path,
+    const IngestionOptions& options) {
+    CheckOptions(options);
+    const auto file = MappedFile::Open(path);
+    std::string_view rest = file->GetData();
+    return Pipeline(search_server, options).Run([&](Chunk& chunk) {
+        if (rest.empty()) {
+            return false;
+        }
+        const size_t line_end = options.chunk_size < rest.size() ? rest.find('\n', options.chunk_size - 1) : rest.npos;
+        const size_t size = line_end == rest.npos ? rest.size() : line_end + 1;
+        chunk = { file, rest.substr(0, size) };
+        rest.remove_prefix(size);
+        return true;
+        });
+}
+
+IngestionStats IngestDocuments(SearchServer& search_server, std::istream& input,
+    const IngestionOptions& options) {
+    CheckOptions(options);
+    std::string partial_line;
+    return Pipeline(search_server, options).Run([&](Chunk& chunk) {
+        while (true) {
+            auto block = std::make_shared<std::string>(std::move(partial_line));
+            partial_line.clear();
+            const size_t kept = block->size();
+            block->resize(kept + options.chunk_size);
+            input.read(block->data() + kept, static_cast<std::streamsize>(options.chunk_size));
+            block->resize(kept + static_cast<size_t>(input.gcount()));
+            if (block->size() == kept) {
+                // End of input, the last line may lack its line break
+                if (block->empty()) {
+                    return false;
+                }
+                chunk = { block, *block };
+                return true;
+            }
+            const size_t last_line_end = block->rfind('\n');
+            if (last_line_end == block->npos) {
+                // A line longer than a chunk
+                partial_line = std::move(*block);
+                continue;
+            }
+            partial_line.assign(*block, last_line_end + 1);
+            block->resize(last_line_end + 1);
+            chunk = { block, *block };
+            return true;
+        }
+        });
+}
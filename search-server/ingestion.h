@@ -0,0 +1,57 @@
+#pragma once
+#include "search_server.h"
+#include <chrono>
+#include <cstddef>
+#include <istream>
+#include <ostream>
+#include <string>
+
+// Streaming bulk load of documents in a line-delimited format, one document
+// per line:
+//     <id>\t<status>\t<ratings>\t<text>
+// The status is ACTUAL, IRRELEVANT, BANNED or REMOVED, the ratings are
+// integers separated by spaces and may be empty. Empty lines are skipped.
+//
+// The load runs as a pipeline: a reader hands chunks of whole lines to
+// workers that parse the documents, tokenize them and count term
+// frequencies, and a single merge stage on the calling thread adds the
+// results to the index. The stages are connected by bounded lock-free
+// queues, so a slow stage holds back the others instead of buffering.
+
+struct IngestionOptions {
+    // Threads of the parse and term frequency stage, 0 takes the cores left
+    // to the reader and the merge stage
+    size_t worker_count = 0;
+    // Bytes the reader hands over at a time, extended to the end of the line.
+    // IngestDocuments throws invalid_argument when it is 0.
+    size_t chunk_size = size_t{ 1 } << 20;
+    // Chunks and analyzed batches in flight between two stages
+    size_t queue_capacity = 64;
+};
+
+struct IngestionStats {
+    size_t bytes_read = 0;
+    size_t documents_indexed = 0;
+    // Malformed lines and documents with an invalid word or a taken id
+    size_t documents_rejected = 0;
+    // Waits of the reader on a full queue: the workers or the merge stage
+    // are the bottleneck
+    size_t reader_stalls = 0;
+    // Waits of the merge stage on an empty queue: the reader or the workers
+    // are the bottleneck
+    size_t merge_stalls = 0;
+    std::chrono::nanoseconds elapsed{};
+
+    double GetMegabytesPerSecond() const;
+    double GetDocumentsPerSecond() const;
+};
+
+std::ostream& operator<<(std::ostream& out, const IngestionStats& stats);
+
+// Maps the file and indexes the documents in place: the server keeps the
+// mapping. The server must not be used by other threads during the load.
+IngestionStats IngestDocuments(SearchServer& search_server, const std::string& path,
+    const IngestionOptions& options = {});
+// Reads the stream in chunks, which the server keeps instead of per-document copies
+IngestionStats IngestDocuments(SearchServer& search_server, std::istream& input,
+    const IngestionOptions& options = {});
@@ -1,10 +1,22 @@
 ﻿#include "search_server.h"
+#include "counting_memory_resource.h"
 #include "log_duration.h"
+#include <chrono>
 #include <execution>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <memory_resource>
 #include <random>
 #include <string>
 #include <vector>
+#ifndef _WIN32
+#include "ingestion.h"
+#include "shard_router.h"
+#include "shard_server.h"
+#include <signal.h>
+#include <thread>
+#endif
 using namespace std;
 string GenerateWord(mt19937& generator, int max_length) {
     const int length = uniform_int_distribution(1, max_length)(generator);
@@ -57,7 +69,157 @@ void Test(string_view mark, const SearchServer& search_server, const vector<stri
     cout << total_relevance << endl;
 }
 #define TEST(policy) Test(#policy, search_server, queries, execution::policy)
-int main() {
+// Time of the queries under a posting budget and the share of the exact top
+// documents they find
+void BenchmarkPostingBudget(const SearchServer& search_server, const vector<string>& queries,
+    const vector<vector<Document>>& exact_results, size_t posting_budget) {
+    using namespace chrono;
+    SearchOptions options;
+    options.posting_budget = posting_budget;
+    size_t found = 0;
+    size_t expected = 0;
+    const auto start = steady_clock::now();
+    for (size_t i = 0; i < queries.size(); ++i) {
+        const auto documents = search_server.FindTopDocuments(queries[i], DocumentStatus::ACTUAL, options);
+        for (const Document& exact : exact_results[i]) {
+            found += count_if(documents.begin(), documents.end(), [&exact](const Document& document) {
+                return document.id == exact.id;
+            });
+        }
+        expected += exact_results[i].size();
+    }
+    const auto elapsed = steady_clock::now() - start;
+    cout << "budget "sv << posting_budget << ": "sv << duration_cast<milliseconds>(elapsed).count() << " ms, recall "sv
+        << (expected == 0 ? 1.0 : static_cast<double>(found) / expected) << endl;
+}
+// Short queries over a large corpus: their few long posting lists are split
+// across all workers, so par scales with the postings, not with the words
+void BenchmarkShortQueries(mt19937& generator) {
+    const auto dictionary = GenerateDictionary(generator, 100, 10);
+    SearchServer search_server(""s);
+    for (int i = 0; i < 200'000; ++i) {
+        search_server.AddDocument(i, GenerateQuery(generator, dictionary, 10), DocumentStatus::ACTUAL, { 1, 2, 3 });
+    }
+    for (const int word_count : { 1, 2, 3 }) {
+        const auto queries = GenerateQueries(generator, dictionary, 100, word_count);
+        const string words = to_string(word_count) + (word_count == 1 ? " word "s : " words "s);
+        Test(words + "seq"s, search_server, queries, execution::seq);
+        Test(words + "par"s, search_server, queries, execution::par);
+    }
+}
+// Slowest query and the number of truncated ones when every query has the deadline
+void BenchmarkDeadline(const SearchServer& search_server, const vector<string>& queries,
+    chrono::microseconds deadline) {
+    using namespace chrono;
+    nanoseconds slowest{};
+    int truncated_count = 0;
+    for (const string& query : queries) {
+        const auto start = steady_clock::now();
+        const CancellationToken cancellation = CancellationToken::WithTimeout(deadline);
+        bool truncated = false;
+        SearchOptions options;
+        options.cancellation = &cancellation;
+        options.truncated = &truncated;
+        search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, options);
+        slowest = max(slowest, duration_cast<nanoseconds>(steady_clock::now() - start));
+        truncated_count += truncated;
+    }
+    cout << "deadline "sv << deadline.count() << " us: slowest "sv << duration_cast<microseconds>(slowest).count()
+        << " us, truncated "sv << truncated_count << " of "sv << queries.size() << endl;
+}
+// Memory for the index nodes, taken from upstream; null to allocate from upstream directly
+using ResourceFactory = unique_ptr<pmr::memory_resource>(*)(pmr::memory_resource* upstream);
+// Builds an index on the resource, removes every third document and reports the
+// allocations the index makes against the bytes held upstream. Heap overhead
+// and fragmentation inside malloc itself are not visible here.
+void BenchmarkIndexMemory(string_view mark, const vector<string>& documents, ResourceFactory make_resource) {
+    using namespace chrono;
+    CountingMemoryResource upstream(pmr::new_delete_resource());
+    unique_ptr<pmr::memory_resource> resource = make_resource(&upstream);
+    CountingMemoryResource requested(resource != nullptr ? resource.get() : &upstream);
+    auto search_server = make_unique<SearchServer>(""s, TextAnalysis{}, &requested);
+    const auto build_start = steady_clock::now();
+    for (size_t i = 0; i < documents.size(); ++i) {
+        search_server->AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+    }
+    vector<int> removed_ids;
+    for (size_t i = 0; i < documents.size(); i += 3) {
+        removed_ids.push_back(i);
+    }
+    search_server->RemoveDocuments(removed_ids);
+    const auto build_time = steady_clock::now() - build_start;
+    const MemoryStats stats = search_server->GetMemoryStats();
+    const size_t bytes_in_use = *stats.resource_bytes_in_use;
+    const size_t bytes_held = upstream.GetBytesInUse();
+    const auto teardown_start = steady_clock::now();
+    search_server.reset();
+    resource.reset();
+    const auto teardown_time = steady_clock::now() - teardown_start;
+    cout << mark << ": build "sv << duration_cast<milliseconds>(build_time).count() << " ms, teardown "sv
+        << duration_cast<milliseconds>(teardown_time).count() << " ms, "sv
+        << requested.GetAllocationCount() << " allocations ("sv << upstream.GetAllocationCount() << " upstream), "sv
+        << bytes_in_use << " bytes in use, "sv << bytes_held << " bytes held (heap model estimate "sv
+        << stats.inverted_index + stats.forward_index << ")"sv << endl;
+}
+#ifndef _WIN32
+// search-server shard SOCKET CORPUS [STOP_WORDS]
+// Indexes the corpus file in the ingestion format and serves it on the
+// socket until SIGINT or SIGTERM
+int RunShard(int argc, char* argv[]) {
+    if (argc < 4 || argc > 5) {
+        cerr << "Usage: "sv << argv[0] << " shard SOCKET CORPUS [STOP_WORDS]"sv << endl;
+        return 2;
+    }
+    SearchServer search_server(string(argc == 5 ? argv[4] : ""));
+    cerr << IngestDocuments(search_server, string(argv[3])) << endl;
+    // The signals are taken by sigwait on a dedicated thread: Stop is not
+    // safe to call from a signal handler
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    ShardServer shard_server(search_server, argv[2]);
+    thread([&shard_server, signals] {
+        int signal_number = 0;
+        sigwait(&signals, &signal_number);
+        shard_server.Stop();
+    }).detach();
+    shard_server.Run();
+    return 0;
+}
+// search-server router SOCKET...
+// Answers the queries of the standard input, one per line, with the top
+// documents merged over the shards
+int RunRouter(int argc, char* argv[]) {
+    if (argc < 3) {
+        cerr << "Usage: "sv << argv[0] << " router SOCKET..."sv << endl;
+        return 2;
+    }
+    const ShardRouter router(vector<string>(argv + 2, argv + argc));
+    for (string query; getline(cin, query);) {
+        try {
+            for (const Document& document : router.FindTopDocuments(query)) {
+                cout << document << '\n';
+            }
+        }
+        catch (const invalid_argument& e) {
+            cout << "Error: "sv << e.what() << '\n';
+        }
+        cout << endl;
+    }
+    return 0;
+}
+#endif
+int main(int argc, char* argv[]) {
+#ifndef _WIN32
+    if (argc >= 2 && argv[1] == "shard"sv) {
+        return RunShard(argc, argv);
+    }
+    if (argc >= 2 && argv[1] == "router"sv) {
+        return RunRouter(argc, argv);
+    }
+#endif
     mt19937 generator;
     const auto dictionary = GenerateDictionary(generator, 1000, 10);
     const auto documents = GenerateQueries(generator, dictionary, 10'000, 70);
@@ -68,4 +230,25 @@ int main() {
     const auto queries = GenerateQueries(generator, dictionary, 100, 70);
     TEST(seq);
     TEST(par);
+    for (const int deadline : { 100, 1000 }) {
+        BenchmarkDeadline(search_server, queries, chrono::microseconds(deadline));
+    }
+    vector<vector<Document>> exact_results;
+    for (const string& query : queries) {
+        exact_results.push_back(search_server.FindTopDocuments(execution::seq, query));
+    }
+    search_server.BuildImpactIndex();
+    for (const size_t posting_budget : { size_t{ 10'000 }, size_t{ 30'000 }, size_t{ 100'000 }, numeric_limits<size_t>::max() }) {
+        BenchmarkPostingBudget(search_server, queries, exact_results, posting_budget);
+    }
+    BenchmarkShortQueries(generator);
+    BenchmarkIndexMemory("heap"sv, documents, [](pmr::memory_resource*) {
+        return unique_ptr<pmr::memory_resource>();
+    });
+    BenchmarkIndexMemory("pool"sv, documents, [](pmr::memory_resource* upstream) -> unique_ptr<pmr::memory_resource> {
+        return make_unique<pmr::unsynchronized_pool_resource>(upstream);
+    });
+    BenchmarkIndexMemory("arena"sv, documents, [](pmr::memory_resource* upstream) -> unique_ptr<pmr::memory_resource> {
+        return make_unique<pmr::monotonic_buffer_resource>(upstream);
+    });
 }
\ No newline at end of file
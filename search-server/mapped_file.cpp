@@ -0,0 +1,101 @@
+#include "mapped_file.h"
+#include <system_error>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std::string_literals;
+
+#ifdef _WIN32
+std::shared_ptr<const MappedFile> MappedFile::Open(const std::string& path) {
+    const HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw std::system_error(static_cast<int>(GetLastError()), std::system_category(), "CreateFile "s + path);
+    }
+    LARGE_INTEGER file_size{};
+    if (!GetFileSizeEx(file, &file_size)) {
+        const DWORD error = GetLastError();
+        CloseHandle(file);
+        throw std::system_error(static_cast<int>(error), std::system_category(), "GetFileSizeEx "s + path);
+    }
+    const size_t size = static_cast<size_t>(file_size.QuadPart);
+    const void* data = nullptr;
+    // An empty file cannot be mapped
+    if (size > 0) {
+        const HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr) {
+            const DWORD error = GetLastError();
+            CloseHandle(file);
+            throw std::system_error(static_cast<int>(error), std::system_category(), "CreateFileMapping "s + path);
+        }
+        data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        const DWORD error = GetLastError();
+        // The view keeps the mapping alive after its handle is closed
+        CloseHandle(mapping);
+        if (data == nullptr) {
+            CloseHandle(file);
+            throw std::system_error(static_cast<int>(error), std::system_category(), "MapViewOfFile "s + path);
+        }
+    }
+    CloseHandle(file);
+    return std::shared_ptr<const MappedFile>(new MappedFile(static_cast<const char*>(data), size));
+}
+#else
+std::shared_ptr<const MappedFile> MappedFile::Open(const std::string& path) {
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "open "s + path);
+    }
+    struct stat file_stat {};
+    if (fstat(fd, &file_stat) != 0) {
+        const int error = errno;
+        close(fd);
+        throw std::system_error(error, std::generic_category(), "fstat "s + path);
+    }
+    const size_t size = static_cast<size_t>(file_stat.st_size);
+    void* data = nullptr;
+    // An empty file cannot be mapped
+    if (size > 0) {
+        data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            const int error = errno;
+            close(fd);
+            throw std::system_error(error, std::generic_category(), "mmap "s + path);
+        }
+        // Documents are indexed front to back
+        madvise(data, size, MADV_SEQUENTIAL);
+    }
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+    return std::shared_ptr<const MappedFile>(new MappedFile(static_cast<const char*>(data), size));
+}
+#endif // _WIN32
+
+MappedFile::MappedFile(const char* data, size_t size)
+    : data_(data)
+    , size_(size) {
+}
+
+MappedFile::~MappedFile() {
+    if (data_ != nullptr) {
+#ifdef _WIN32
+        UnmapViewOfFile(data_);
+#else
+        munmap(const_cast<char*>(data_), size_);
+#endif
+    }
+}
+
+std::string_view MappedFile::GetData() const {
+    return { data_, size_ };
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// Read-only memory mapping of a whole file. Documents cut from the mapping
+// can be indexed without copying by passing the mapping as their owner to
+// SearchServer::AddDocument.
+class MappedFile {
+public:
+    static std::shared_ptr<const MappedFile> Open(const std::string& path);
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    std::string_view GetData() const;
+
+private:
+    MappedFile(const char* data, size_t size);
+
+    const char* data_;
+    size_t size_;
+};
@@ -0,0 +1,69 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Memory footprint of a SearchServer. The per-component figures and the total
+// are estimates from the heap model below, not measurements: they are off on
+// other allocators (e.g. MSVC) and when the index allocates from a pool or
+// arena resource.
+struct MemoryStats {
+    size_t inverted_index = 0;
+    size_t forward_index = 0;
+    size_t document_attributes = 0;
+    size_t retained_text = 0;
+    size_t stop_words = 0;
+    size_t total = 0;
+
+    // Measured bytes in use in the server's memory resource when it is a
+    // CountingMemoryResource: the posting lists, forward index and document
+    // set, plus whatever else allocates from the same resource
+    std::optional<size_t> resource_bytes_in_use;
+
+    size_t term_count = 0;
+    size_t posting_count = 0;
+    // Terms with the longest posting lists and their posting counts, longest first
+    std::vector<std::pair<std::string_view, size_t>> largest_posting_lists;
+};
+
+// Heap footprint model of the standard containers on a 64-bit glibc system:
+// every allocation carries an 8-byte chunk header, is rounded up to 16 bytes
+// and takes at least 32 bytes. A red-black tree node adds 32 bytes of links
+// and color in front of its value.
+constexpr size_t TREE_NODE_HEADER_SIZE = 32;
+
+constexpr size_t EstimateAllocation(size_t bytes) {
+    const size_t chunk = (bytes + 8 + 15) / 16 * 16;
+    return chunk < 32 ? 32 : chunk;
+}
+
+template <typename Tree>
+size_t EstimateTreeNodes(const Tree& tree) {
+    return tree.size() * EstimateAllocation(TREE_NODE_HEADER_SIZE + sizeof(typename Tree::value_type));
+}
+
+// A hash table node holds the link to the next node and the value, the
+// bucket array a pointer per bucket
+template <typename HashTable>
+size_t EstimateHashNodes(const HashTable& table) {
+    return table.size() * EstimateAllocation(sizeof(void*) + sizeof(typename HashTable::value_type))
+        + EstimateAllocation(table.bucket_count() * sizeof(void*));
+}
+
+inline size_t EstimateStringHeap(const std::string& str) {
+    // Short strings live inside the std::string object itself
+    return str.capacity() > 15 ? EstimateAllocation(str.capacity() + 1) : 0;
+}
+
+template <typename Deque>
+size_t EstimateDequeBlocks(const Deque& deque) {
+    // libstdc++ allocates 512-byte blocks plus the array of block pointers
+    const size_t per_block = std::max<size_t>(1, 512 / sizeof(typename Deque::value_type));
+    const size_t blocks = deque.size() / per_block + 1;
+    return blocks * EstimateAllocation(per_block * sizeof(typename Deque::value_type))
+        + EstimateAllocation(std::max<size_t>(8, blocks + 2) * sizeof(void*));
+}
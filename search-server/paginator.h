@@ -2,6 +2,8 @@
 #include <iostream>
 #include <vector>
 #include <algorithm>
+#include <iterator>
+#include <stdexcept>
 
 template <typename Iterator>
 class IteratorRange {
@@ -77,3 +79,95 @@ template <typename Container>
 auto Paginate(const Container& c, size_t page_size) {
     return Paginator(begin(c), end(c), page_size);
 }
+
+// Paginator that keeps only the bounds of the sequence and builds a page on
+// request, so nothing is materialized up front. Page access is O(1) for
+// random-access iterators.
+template <typename Iterator>
+class LazyPaginator {
+public:
+    class PageIterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = IteratorRange<Iterator>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = value_type;
+
+        PageIterator(const LazyPaginator* paginator, size_t page);
+        IteratorRange<Iterator> operator*() const;
+        PageIterator& operator++();
+        bool operator==(const PageIterator& other) const;
+        bool operator!=(const PageIterator& other) const;
+    private:
+        const LazyPaginator* paginator_;
+        size_t page_;
+    };
+
+    LazyPaginator(Iterator begin, Iterator end, size_t page_size);
+    IteratorRange<Iterator> GetPage(size_t page) const;
+    PageIterator begin() const;
+    PageIterator end() const;
+    size_t size() const;
+private:
+    Iterator begin_;
+    size_t item_count_;
+    size_t page_size_;
+};
+template <typename Iterator>
+LazyPaginator<Iterator>::PageIterator::PageIterator(const LazyPaginator* paginator, size_t page)
+    : paginator_(paginator)
+    , page_(page) {
+}
+template <typename Iterator>
+IteratorRange<Iterator> LazyPaginator<Iterator>::PageIterator::operator*() const {
+    return paginator_->GetPage(page_);
+}
+template <typename Iterator>
+typename LazyPaginator<Iterator>::PageIterator& LazyPaginator<Iterator>::PageIterator::operator++() {
+    ++page_;
+    return *this;
+}
+template <typename Iterator>
+bool LazyPaginator<Iterator>::PageIterator::operator==(const PageIterator& other) const {
+    return page_ == other.page_;
+}
+template <typename Iterator>
+bool LazyPaginator<Iterator>::PageIterator::operator!=(const PageIterator& other) const {
+    return page_ != other.page_;
+}
+template <typename Iterator>
+LazyPaginator<Iterator>::LazyPaginator(Iterator begin, Iterator end, size_t page_size)
+    : begin_(begin)
+    , item_count_(distance(begin, end))
+    , page_size_(page_size) {
+    if (page_size_ == 0) {
+        throw std::invalid_argument("Page size must be positive");
+    }
+}
+template <typename Iterator>
+IteratorRange<Iterator> LazyPaginator<Iterator>::GetPage(size_t page) const {
+    if (page >= size()) {
+        throw std::out_of_range("Page is out of range");
+    }
+    const size_t first = page * page_size_;
+    const Iterator page_begin = next(begin_, first);
+    return { page_begin, next(page_begin, std::min(page_size_, item_count_ - first)) };
+}
+template <typename Iterator>
+typename LazyPaginator<Iterator>::PageIterator LazyPaginator<Iterator>::begin() const {
+    return { this, 0 };
+}
+template <typename Iterator>
+typename LazyPaginator<Iterator>::PageIterator LazyPaginator<Iterator>::end() const {
+    return { this, size() };
+}
+template <typename Iterator>
+size_t LazyPaginator<Iterator>::size() const {
+    return (item_count_ + page_size_ - 1) / page_size_;
+}
+
+template <typename Container>
+auto PaginateLazily(const Container& c, size_t page_size) {
+    return LazyPaginator(begin(c), end(c), page_size);
+}
@@ -1,6 +1,7 @@
 #include "process_queries.h"
 #include <algorithm>
 #include <execution>
+#include <utility>
 
 std::vector<std::vector<Document>> ProcessQueries(const SearchServer& search_server,
 	const std::vector<std::string>& queries)
@@ -13,6 +14,30 @@ std::vector<std::vector<Document>> ProcessQueries(const SearchServer& search_ser
 	return result;
 }
 
+std::vector<std::vector<Document>> ProcessQueries(const SearchServer& search_server,
+	const std::vector<std::string>& queries, const CancellationToken& cancellation, std::vector<bool>& truncated)
+{
+	std::vector<std::pair<std::vector<Document>, bool>> answers(queries.size());
+	std::transform(std::execution::par, queries.begin(), queries.end(), answers.begin(),
+		[&search_server, &cancellation](std::string_view str) {
+			std::pair<std::vector<Document>, bool> answer;
+			SearchOptions options;
+			options.cancellation = &cancellation;
+			options.truncated = &answer.second;
+			answer.first = search_server.FindTopDocuments(str, DocumentStatus::ACTUAL, options);
+			return answer;
+		});
+
+	std::vector<std::vector<Document>> result;
+	result.reserve(answers.size());
+	truncated.clear();
+	for (auto& [documents, is_truncated] : answers) {
+		result.push_back(std::move(documents));
+		truncated.push_back(is_truncated);
+	}
+	return result;
+}
+
 std::vector<Document> ProcessQueriesJoined(const SearchServer& search_server,
 	const std::vector<std::string>& queries)
 {
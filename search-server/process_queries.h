@@ -8,6 +8,14 @@ std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
     const std::vector<std::string>& queries);
 
+// Every query stops once the token fires and returns the best documents it
+// scored until then; truncated[i] tells whether query i was cut short
+std::vector<std::vector<Document>> ProcessQueries(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries,
+    const CancellationToken& cancellation,
+    std::vector<bool>& truncated);
+
 std::vector<Document> ProcessQueriesJoined(
     const SearchServer& search_server,
     const std::vector<std::string>& queries);
@@ -0,0 +1,20 @@
+#include "query_stats.h"
+#include <string>
+
+using namespace std::string_literals;
+
+std::ostream& operator<<(std::ostream& out, const QueryStats& stats) {
+    out << "terms = "s << stats.terms_parsed
+        << ", stop words = "s << stats.stop_words
+        << ", unknown = "s << stats.unknown_terms
+        << ", postings = "s << stats.postings_scanned
+        << ", predicate calls = "s << stats.predicate_evaluations
+        << ", excluded = "s << stats.documents_excluded
+        << ", scored = "s << stats.documents_scored
+        << ", candidates = "s << stats.candidates
+        << ", parse = "s << stats.parse_time.count() << " ns"s
+        << ", exclude = "s << stats.exclude_time.count() << " ns"s
+        << ", score = "s << stats.score_time.count() << " ns"s
+        << ", sort = "s << stats.sort_time.count() << " ns"s;
+    return out;
+}
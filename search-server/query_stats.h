@@ -0,0 +1,61 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+
+// Execution statistics of one FindTopDocuments call, collected when
+// SearchOptions::stats points here. Counters add up over the calls that
+// share the object.
+struct QueryStats {
+    // Words of the query text, stop words included
+    size_t terms_parsed = 0;
+    size_t stop_words = 0;
+    // Plus words without documents
+    size_t unknown_terms = 0;
+
+    // Posting list entries visited or probed while scoring
+    size_t postings_scanned = 0;
+    // Calls to the document predicate
+    size_t predicate_evaluations = 0;
+    // Documents with a minus word, among the filter candidates when those
+    // are scanned directly
+    size_t documents_excluded = 0;
+    // Documents given a relevance by the scored terms
+    size_t documents_scored = 0;
+    // Documents ranked for the page, including those matched only by
+    // zero-weight terms
+    size_t candidates = 0;
+
+    std::chrono::nanoseconds parse_time{};
+    std::chrono::nanoseconds exclude_time{};
+    std::chrono::nanoseconds score_time{};
+    std::chrono::nanoseconds sort_time{};
+};
+
+std::ostream& operator<<(std::ostream& out, const QueryStats& stats);
+
+// Adds the time spent in its scope to a duration, does nothing for nullptr
+class StageTimer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit StageTimer(std::chrono::nanoseconds* duration)
+        : duration_(duration) {
+        if (duration_ != nullptr) {
+            start_time_ = Clock::now();
+        }
+    }
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+    ~StageTimer() {
+        if (duration_ != nullptr) {
+            *duration_ += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start_time_);
+        }
+    }
+
+private:
+    std::chrono::nanoseconds* duration_;
+    Clock::time_point start_time_;
+};
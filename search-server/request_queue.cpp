@@ -4,6 +4,7 @@
 RequestQueue::RequestQueue(const SearchServer& search_server)
     : search_server_(search_server)
     , no_results_requests_(0)
+    , truncated_requests_(0)
     , current_time_(0) {
 }
 
@@ -19,11 +20,26 @@ std::vector<Document> RequestQueue::AddFindRequest(const std::string_view& raw_q
     return result;
 }
 
+std::vector<Document> RequestQueue::AddFindRequest(const std::string_view& raw_query, DocumentStatus status,
+    const CancellationToken& cancellation) {
+    bool truncated = false;
+    SearchOptions options;
+    options.cancellation = &cancellation;
+    options.truncated = &truncated;
+    const auto result = search_server_.FindTopDocuments(raw_query, status, options);
+    AddRequest(result.size(), truncated);
+    return result;
+}
+
+int RequestQueue::GetTruncatedRequests() const {
+    return truncated_requests_;
+}
+
 int RequestQueue::GetNoResultRequests() const {
     return no_results_requests_;
 }
 
-void RequestQueue::AddRequest(int results_num) {
+void RequestQueue::AddRequest(int results_num, bool truncated) {
     //   -  
     ++current_time_;
     //    ,  
@@ -31,11 +47,13 @@ void RequestQueue::AddRequest(int results_num) {
         if (0 == requests_.front().results) {
             --no_results_requests_;
         }
+        truncated_requests_ -= requests_.front().truncated;
         requests_.pop_front();
     }
     //    
-    requests_.push_back({ current_time_, results_num });
+    requests_.push_back({ current_time_, results_num, truncated });
     if (0 == results_num) {
         ++no_results_requests_;
     }
+    truncated_requests_ += truncated;
 }
\ No newline at end of file
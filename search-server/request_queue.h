@@ -11,19 +11,26 @@ public:
     std::vector<Document> AddFindRequest(const std::string_view& raw_query, DocumentPredicate document_predicate);
     std::vector<Document> AddFindRequest(const std::string_view& raw_query, DocumentStatus status);
     std::vector<Document> AddFindRequest(const std::string_view& raw_query);
+    // Stops the search once the token fires and returns the best documents found until then
+    std::vector<Document> AddFindRequest(const std::string_view& raw_query, DocumentStatus status,
+        const CancellationToken& cancellation);
     int GetNoResultRequests() const;
+    // Requests cut short by their cancellation token, over the same window
+    int GetTruncatedRequests() const;
 private:
     struct QueryResult {
         uint64_t timestamp;
         int results;
+        bool truncated;
     };
     std::deque<QueryResult> requests_;
     const SearchServer& search_server_;
     int no_results_requests_;
+    int truncated_requests_;
     uint64_t current_time_;
     const static int min_in_day_ = 1440;
 
-    void AddRequest(int results_num);
+    void AddRequest(int results_num, bool truncated = false);
 };
 
 template <typename DocumentPredicate>
@@ -2,70 +2,289 @@
 
 using namespace std::string_literals;
 
-SearchServer::SearchServer(std::string stop_words_text)
-	: SearchServer(SplitIntoWords(stop_words_text)) {
+SearchServer::SearchServer(std::string stop_words_text, TextAnalysis analysis,
+	std::pmr::memory_resource* memory_resource)
+	: SearchServer(TextProcessor(std::string_view(stop_words_text), analysis), memory_resource) {
 }
 
-SearchServer::SearchServer(std::string_view stop_words_text)
-	: SearchServer(SplitIntoWords(stop_words_text)) {
+SearchServer::SearchServer(std::string_view stop_words_text, TextAnalysis analysis,
+	std::pmr::memory_resource* memory_resource)
+	: SearchServer(TextProcessor(stop_words_text, analysis), memory_resource) {
+}
+
+SearchServer::SearchServer(TextProcessor text_processor, std::pmr::memory_resource* memory_resource)
+	: text_processor_(std::move(text_processor))
+	, word_to_document_freqs_(memory_resource)
+	, document_ids_freqs_(memory_resource)
+	, document_ids_(memory_resource)
+	, impact_postings_(memory_resource) {
 }
 
 void SearchServer::AddDocument(int document_id, std::string_view document, DocumentStatus status,
 	const std::vector<int>& ratings) {
-	if ((document_id < 0) || (documents_.count(document_id) > 0)) {
+	if ((document_id < 0) || document_attributes_.Contains(document_id)) {
 		throw std::invalid_argument("Invalid document_id"s);
 	}
 
 	words.push_back(static_cast<std::string>(document));
 
-	std::vector<std::string_view> container_words(SplitIntoWordsNoStop(words.back()));
+	IndexDocument(document_id, text_processor_.SplitIntoWordsNoStop(words.back()), status, ratings, false);
+}
+
+void SearchServer::AddDocument(int document_id, std::string_view document, DocumentStatus status,
+	const std::vector<int>& ratings, std::shared_ptr<const void> owner) {
+	if (text_processor_.GetAnalysis().fold_case) {
+		AddDocument(document_id, document, status, ratings);
+		return;
+	}
+	if ((document_id < 0) || document_attributes_.Contains(document_id)) {
+		throw std::invalid_argument("Invalid document_id"s);
+	}
+
+	const std::vector<std::string_view> document_words = text_processor_.SplitIntoWordsNoStop(document);
+	RetainOwner(std::move(owner));
+	IndexDocument(document_id, document_words, status, ratings, true);
+}
+
+std::vector<std::pair<std::string_view, double>> SearchServer::ComputeTermFrequencies(std::string_view document) const {
+	return CountTermFrequencies(text_processor_.SplitIntoWordsNoStop(document));
+}
+
+std::vector<std::pair<std::string_view, double>> SearchServer::CountTermFrequencies(
+	std::vector<std::string_view> document_words) {
+	const double inv_word_count = 1.0 / document_words.size();
+	std::sort(document_words.begin(), document_words.end());
+
+	std::vector<std::pair<std::string_view, double>> term_freqs;
+	for (std::string_view word : document_words) {
+		if (term_freqs.empty() || term_freqs.back().first != word) {
+			term_freqs.emplace_back(word, 0.0);
+		}
+		// Summed as IndexDocument does, so that unchanged words compare equal
+		term_freqs.back().second += inv_word_count;
+	}
+	return term_freqs;
+}
+
+void SearchServer::AddAnalyzedDocument(int document_id, const std::vector<std::pair<std::string_view, double>>& term_freqs,
+	DocumentStatus status, const std::vector<int>& ratings, std::shared_ptr<const void> owner) {
+	if ((document_id < 0) || document_attributes_.Contains(document_id)) {
+		throw std::invalid_argument("Invalid document_id"s);
+	}
+
+	RetainOwner(std::move(owner));
+	DropImpactIndex();
+	const uint32_t slot = document_attributes_.Add(document_id, ComputeAverageRating(ratings), status);
+	auto& word_freqs = document_ids_freqs_[document_id];
+	for (const auto& [word, term_freq] : term_freqs) {
+		IndexWord(slot, word, term_freq, true, word_freqs);
+	}
+	document_ids_.insert(document_id);
+}
+
+const TextAnalysis& SearchServer::GetTextAnalysis() const {
+	return text_processor_.GetAnalysis();
+}
 
-	const double inv_word_count = 1.0 / container_words.size();
+void SearchServer::IndexDocument(int document_id, const std::vector<std::string_view>& document_words,
+	DocumentStatus status, const std::vector<int>& ratings, bool copy_new_terms) {
+	const double inv_word_count = 1.0 / document_words.size();
 
-	for (std::string_view word : container_words) {
-		word_to_document_freqs_[word][document_id] += inv_word_count;
-		document_ids_freqs_[document_id][word] += inv_word_count;
+	DropImpactIndex();
+	const uint32_t slot = document_attributes_.Add(document_id, ComputeAverageRating(ratings), status);
+	auto& word_freqs = document_ids_freqs_[document_id];
+	for (std::string_view word : document_words) {
+		IndexWord(slot, word, inv_word_count, copy_new_terms, word_freqs);
 	}
-	documents_.emplace(document_id, DocumentData{ ComputeAverageRating(ratings), status});
 	document_ids_.insert(document_id);
 }
 
+void SearchServer::IndexWord(int slot, std::string_view word, double term_freq, bool copy_new_term,
+	WordFrequencies& word_freqs) {
+	AddPosting(slot, word, term_freq, copy_new_term);
+	word_freqs[word] += term_freq;
+}
+
+std::string_view SearchServer::AddPosting(int slot, std::string_view word, double term_freq, bool copy_new_term) {
+	auto it = word_to_document_freqs_.lower_bound(word);
+	if (it == word_to_document_freqs_.end() || it->first != word) {
+		const std::string_view term = copy_new_term ? std::string_view(dictionary_terms_.emplace_back(word)) : word;
+		it = word_to_document_freqs_.try_emplace(it, term);
+		term_trie_.Insert(term);
+	}
+	it->second[slot] += term_freq;
+	return it->first;
+}
+
+void SearchServer::DropImpactIndex() {
+	if (has_impact_index_) {
+		impact_postings_.clear();
+		has_impact_index_ = false;
+	}
+}
+
+void SearchServer::RetainOwner(std::shared_ptr<const void> owner) {
+	// Consecutive documents usually come from the same buffer
+	if (owner != nullptr && (borrowed_owners_.empty() || borrowed_owners_.back() != owner)) {
+		borrowed_owners_.push_back(std::move(owner));
+	}
+}
+
 std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query) const {
-	return FindTopDocuments(std::execution::seq, raw_query, DocumentStatus::ACTUAL);
+	return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
 }
 
 std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentStatus status) const {
-	return FindTopDocuments(
-		std::execution::seq, raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-			return document_status == status;
-		});
+	return FindTopDocuments(raw_query, status, 0, MAX_RESULT_DOCUMENT_COUNT);
+}
+
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, const DocumentFilter& filter) const {
+	const DocumentBitset candidates = document_attributes_.Filter(filter);
+	const auto query = ParseQuery(raw_query, true);
+	return FindTopDocumentsPlanned(query, CandidatePredicate{ &candidates, candidates.Count() },
+		0, MAX_RESULT_DOCUMENT_COUNT);
+}
+
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentStatus status,
+	size_t offset, size_t limit) const {
+	const auto query = ParseQuery(raw_query, true);
+	return FindTopDocumentsPlanned(query, MakeStatusPredicate(status), offset, limit);
+}
+
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentStatus status,
+	const SearchOptions& options) const {
+	const auto query = ParseQuery(raw_query, true, options);
+	return FindTopDocumentsPlanned(query, MakeStatusPredicate(status), 0, MAX_RESULT_DOCUMENT_COUNT);
+}
+
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentStatus status,
+	const TermStatistics& global_statistics) const {
+	auto query = ParseQuery(raw_query, true);
+	query.global_statistics = &global_statistics;
+	return FindTopDocumentsPlanned(query, MakeStatusPredicate(status), 0, MAX_RESULT_DOCUMENT_COUNT);
+}
+
+TermStatistics SearchServer::GetTermStatistics(std::string_view raw_query) const {
+	const auto query = ParseQuery(raw_query, true);
+	TermStatistics statistics;
+	statistics.document_count = GetDocumentCount();
+	for (std::string_view word : query.plus_words) {
+		const auto it = word_to_document_freqs_.find(word);
+		statistics.document_freqs.emplace(word, it == word_to_document_freqs_.end() ? 0 : static_cast<int>(it->second.size()));
+	}
+	return statistics;
+}
+
+std::vector<Document> SearchServer::FindTopDocumentsPlanned(const Query& query, const CandidatePredicate& predicate,
+	size_t offset, size_t limit) const {
+	return RankDocuments(std::execution::seq, query, PlanQuery(query), predicate, offset, limit);
+}
+
+QueryPlan SearchServer::ExplainQuery(std::string_view raw_query, const SearchOptions& options) const {
+	return PlanQuery(ParseQuery(raw_query, true, options));
+}
+
+void SearchServer::BuildImpactIndex() {
+	impact_postings_.clear();
+	std::vector<ImpactOrderedPostings::Posting> postings;
+	for (const auto& [word, document_freqs] : word_to_document_freqs_) {
+		if (document_freqs.empty()) {
+			continue;
+		}
+		postings.clear();
+		for (const auto [slot, term_freq] : document_freqs) {
+			postings.push_back({ slot, static_cast<float>(term_freq) });
+		}
+		impact_postings_.emplace_hint(impact_postings_.end(), word, ImpactOrderedPostings(postings));
+	}
+	has_impact_index_ = true;
+}
+
+bool SearchServer::HasImpactIndex() const {
+	return has_impact_index_;
 }
 
 int SearchServer::GetDocumentCount() const {
-	return documents_.size();
+	return document_attributes_.GetDocumentCount();
+}
+
+MemoryStats SearchServer::GetMemoryStats(size_t top_term_count) const {
+	MemoryStats stats;
+	stats.term_count = word_to_document_freqs_.size();
+
+	stats.inverted_index = EstimateTreeNodes(word_to_document_freqs_) + term_trie_.GetMemoryUsage();
+	std::vector<std::pair<std::string_view, size_t>> posting_sizes;
+	posting_sizes.reserve(word_to_document_freqs_.size());
+	for (const auto& [word, document_freqs] : word_to_document_freqs_) {
+		stats.inverted_index += document_freqs.GetMemoryUsage();
+		stats.posting_count += document_freqs.size();
+		posting_sizes.emplace_back(word, document_freqs.size());
+	}
+
+	stats.inverted_index += EstimateTreeNodes(impact_postings_);
+	for (const auto& [_, postings] : impact_postings_) {
+		stats.inverted_index += postings.GetMemoryUsage();
+	}
+
+	stats.forward_index = EstimateTreeNodes(document_ids_freqs_);
+	for (const auto& [_, word_freqs] : document_ids_freqs_) {
+		stats.forward_index += EstimateTreeNodes(word_freqs);
+	}
+
+	stats.document_attributes = document_attributes_.GetMemoryUsage() + EstimateTreeNodes(document_ids_);
+
+	// Borrowed documents belong to their owners and are not counted
+	stats.retained_text = EstimateDequeBlocks(words) + EstimateDequeBlocks(dictionary_terms_)
+		+ borrowed_owners_.capacity() * sizeof(std::shared_ptr<const void>);
+	for (const std::string& text : words) {
+		stats.retained_text += EstimateStringHeap(text);
+	}
+	for (const std::string& term : dictionary_terms_) {
+		stats.retained_text += EstimateStringHeap(term);
+	}
+
+	stats.stop_words = text_processor_.GetStopWords().GetMemoryUsage();
+
+	stats.total = sizeof(*this) + stats.inverted_index + stats.forward_index + stats.document_attributes
+		+ stats.retained_text + stats.stop_words;
+	if (const auto* counting = dynamic_cast<const CountingMemoryResource*>(
+		word_to_document_freqs_.get_allocator().resource())) {
+		stats.resource_bytes_in_use = counting->GetBytesInUse();
+	}
+
+	const size_t top_count = std::min(top_term_count, posting_sizes.size());
+	std::partial_sort(posting_sizes.begin(), posting_sizes.begin() + top_count, posting_sizes.end(),
+		[](const auto& lhs, const auto& rhs) {
+			return lhs.second > rhs.second || (lhs.second == rhs.second && lhs.first < rhs.first);
+		});
+	posting_sizes.resize(top_count);
+	stats.largest_posting_lists = std::move(posting_sizes);
+	return stats;
 }
 
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::string_view raw_query,
 	int document_id) const {
 	const auto query = ParseQuery(raw_query, true);
+	const uint32_t slot = GetDocumentSlot(document_id);
 	
 	std::vector<std::string_view> matched_words(query.plus_words.size());
 
 	if (std::any_of(query.minus_words.begin(), query.minus_words.end(),
 		[&](auto& word) {
-			return word_to_document_freqs_.at(word).count(document_id);
+			return DocumentContainsWord(word, slot);
 		})) {
 		matched_words.clear();
 	}
 	else {
 		auto it = std::copy_if(query.plus_words.begin(), query.plus_words.end(),
 			matched_words.begin(), [&](auto& word) {
-				return word_to_document_freqs_.at(word).count(document_id);
+				return DocumentContainsWord(word, slot);
 			});
 		matched_words.erase(it, matched_words.end());
 	}
+	PointToDictionary(matched_words);
 	
-	return std::tuple(matched_words, documents_.at(document_id).status);
+	return std::tuple(matched_words, GetDocumentStatus(document_id));
 }
 
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::execution::sequenced_policy parallel,
@@ -76,127 +295,399 @@ std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDoc
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::execution::parallel_policy parallel,
 	std::string_view raw_query, int document_id) const {
 	const auto query = ParseQuery(raw_query, false);
+	const uint32_t slot = GetDocumentSlot(document_id);
 	std::vector<std::string_view> matched_words(query.plus_words.size());
 
 	if (std::any_of(parallel, query.minus_words.begin(), query.minus_words.end(),
 		[&](auto& word) {
-			return word_to_document_freqs_.at(word).count(document_id);
+			return DocumentContainsWord(word, slot);
 		})) {
 		matched_words.clear();
 	}
 	else {
 		auto it = std::copy_if(parallel, query.plus_words.begin(), query.plus_words.end(),
 			matched_words.begin(), [&](auto& word) {
-				return word_to_document_freqs_.at(word).count(document_id);
+				return DocumentContainsWord(word, slot);
 			});
 		std::sort(parallel, matched_words.begin(), it);
 		auto last = std::unique(parallel, matched_words.begin(), it);
 		matched_words.erase(last, matched_words.end());
 	}
+	PointToDictionary(matched_words);
 
-	return std::tuple(matched_words, documents_.at(document_id).status);
+	return std::tuple(matched_words, GetDocumentStatus(document_id));
 }
 
-bool SearchServer::IsStopWord(std::string_view word) const {
-	return stop_words_.count(word) > 0;
+void SearchServer::PointToDictionary(std::vector<std::string_view>& words) const {
+	for (std::string_view& word : words) {
+		word = word_to_document_freqs_.find(word)->first;
+	}
 }
 
-bool SearchServer::IsValidWord(std::string_view word) {
-	// A valid word must not contain special characters
-	return std::none_of(word.begin(), word.end(), [](char c) {
-		return c >= '\0' && c < ' ';
+bool SearchServer::DocumentContainsWord(std::string_view word, int slot) const {
+	const auto it = word_to_document_freqs_.find(word);
+	return it != word_to_document_freqs_.end() && it->second.count(slot) > 0;
+}
+
+void SearchServer::EraseDocumentData(int document_id) {
+	DropImpactIndex();
+	document_attributes_.Remove(document_id);
+	document_ids_freqs_.erase(document_id);
+	document_ids_.erase(document_id);
+}
+
+DocumentStatus SearchServer::GetDocumentStatus(int document_id) const {
+	return document_attributes_.GetStatus(GetDocumentSlot(document_id));
+}
+
+uint32_t SearchServer::GetDocumentSlot(int document_id) const {
+	if (!document_attributes_.Contains(document_id)) {
+		throw std::out_of_range("Document "s + std::to_string(document_id) + " is not found"s);
+	}
+	return document_attributes_.GetSlot(document_id);
+}
+
+DocumentBitset SearchServer::ComputeExcludedDocuments(const Query& query) const {
+	DocumentBitset excluded_documents;
+	for (std::string_view word : query.minus_words) {
+		const auto it = word_to_document_freqs_.find(word);
+		if (it == word_to_document_freqs_.end()) {
+			continue;
+		}
+		it->second.AddTo(excluded_documents);
+	}
+	return excluded_documents;
+}
+
+SearchServer::CandidatePredicate SearchServer::MakeStatusPredicate(DocumentStatus status) const {
+	return { &document_attributes_.GetStatusDocuments(status), document_attributes_.GetStatusDocumentCount(status) };
+}
+
+bool SearchServer::PreferCandidateScan(const QueryPlan& plan, const CandidatePredicate& predicate) const {
+	// A forward index probe costs a few posting visits
+	const size_t scan_cost = predicate.candidates->GetWords().size()
+		+ predicate.candidate_count * (plan.scored_terms.size() + plan.minus_word_count) * 4;
+	return scan_cost < plan.estimated_postings;
+}
+
+std::vector<Document> SearchServer::FindCandidateDocuments(const Query& query, const QueryPlan& plan,
+	const DocumentBitset& candidates, CancellationCheck& cancellation) const {
+	std::vector<Document> matched_documents;
+	size_t probe_count = 0;
+	size_t excluded_count = 0;
+	candidates.ForEach([&](size_t slot) {
+		if (cancellation.Poll()) {
+			return;
+		}
+		const int document_id = document_attributes_.GetDocumentId(static_cast<uint32_t>(slot));
+		const auto& word_freqs = document_ids_freqs_.at(document_id);
+		probe_count += query.minus_words.size() + plan.scored_terms.size();
+		if (std::any_of(query.minus_words.begin(), query.minus_words.end(), [&word_freqs](std::string_view word) {
+			return word_freqs.count(word) > 0;
+			})) {
+			++excluded_count;
+			return;
+		}
+		double relevance = 0;
+		bool matched = false;
+		for (const QueryPlan::Term& term : plan.scored_terms) {
+			const auto it = word_freqs.find(term.word);
+			if (it != word_freqs.end()) {
+				relevance += it->second * term.weight;
+				matched = true;
+			}
+		}
+		if (matched) {
+			matched_documents.push_back({ document_id, relevance,
+				document_attributes_.GetRating(static_cast<uint32_t>(slot)) });
+		}
 		});
+	if (query.stats != nullptr) {
+		query.stats->postings_scanned += probe_count;
+		query.stats->documents_excluded += excluded_count;
+	}
+	return matched_documents;
 }
 
-std::vector<std::string_view> SearchServer::SplitIntoWordsNoStop(std::string_view text) const {
-	std::vector<std::string_view> words;
-	for (std::string_view word : SplitIntoWords(text)) {
-		if (!IsValidWord(word)) {
-			throw std::invalid_argument("Word "s + std::string(word) + " is invalid"s);
+void SearchServer::DenseScores::Reset() {
+	for (const int slot : touched) {
+		scores[slot] = 0;
+		is_touched[slot] = 0;
+	}
+	touched.clear();
+}
+
+bool SearchServer::RanksBefore(const Document& lhs, const Document& rhs) {
+	if (std::abs(lhs.relevance - rhs.relevance) < EPS) {
+		return lhs.rating > rhs.rating || (lhs.rating == rhs.rating && lhs.id < rhs.id);
+	}
+	return lhs.relevance > rhs.relevance;
+}
+
+bool SearchServer::IsTopStable(const DenseScores& dense, size_t top_count, double remaining_impact,
+	std::vector<double>& scores) {
+	if (top_count == 0) {
+		return true;
+	}
+	scores.clear();
+	for (const int slot : dense.touched) {
+		if (dense.is_touched[slot] == DenseScores::ACCEPTED) {
+			scores.push_back(dense.scores[slot]);
 		}
-		if (!IsStopWord(word)) {
-			words.push_back(word);
+	}
+	// Untouched documents can still fill a short page
+	if (scores.size() < top_count) {
+		return false;
+	}
+	double outside_best = 0;
+	if (scores.size() > top_count) {
+		std::nth_element(scores.begin(), scores.begin() + top_count, scores.end(), std::greater<>());
+		outside_best = scores[top_count];
+	}
+	const double top_worst = *std::min_element(scores.begin(), scores.begin() + top_count);
+	return top_worst > outside_best + remaining_impact + EPS;
+}
+
+double SearchServer::ComputeRelevance(int document_id, const QueryPlan& plan) const {
+	const auto& word_freqs = document_ids_freqs_.at(document_id);
+	double relevance = 0;
+	for (const QueryPlan::Term& term : plan.scored_terms) {
+		const auto it = word_freqs.find(term.word);
+		if (it != word_freqs.end()) {
+			relevance += it->second * term.weight;
 		}
 	}
-	return words;
+	return relevance;
+}
+
+SearchServer::DenseScores& SearchServer::GetThreadDenseScores() {
+	thread_local DenseScores dense_scores;
+	return dense_scores;
 }
 
-int SearchServer::ComputeAverageRating(const std::vector<int>& ratings) {
-	return std::accumulate(ratings.begin(), ratings.end(), 0) / static_cast<int>(ratings.size());
+bool SearchServer::PreferDenseScores(const QueryPlan& plan) const {
+	return plan.estimated_postings * DENSE_SCORES_MIN_DENSITY >= document_attributes_.GetSlotBound();
 }
 
-SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text) const {
-	if (text.empty()) {
-		throw std::invalid_argument("Query word is empty"s);
+QueryPlan SearchServer::PlanQuery(const Query& query) const {
+	QueryPlan plan;
+	plan.mode = query.mode;
+	plan.minus_word_count = query.minus_words.size();
+	const size_t document_count = static_cast<size_t>(GetDocumentCount());
+	for (std::string_view word : query.plus_words) {
+		const auto it = word_to_document_freqs_.find(word);
+		if (it == word_to_document_freqs_.end() || it->second.empty()) {
+			plan.unknown_words.emplace_back(word);
+			continue;
+		}
+		const QueryPlan::Term term{ it->first, it->second.size(), ComputeWordWeight(word, query) };
+		// With global statistics a zero IDF does not mean the term is in
+		// every local document, and ALL queries still have to intersect it
+		if (term.weight == 0 && (query.mode == QueryMode::ANY || term.posting_count == document_count)) {
+			plan.zero_weight_terms.push_back(term);
+		}
+		else {
+			plan.scored_terms.push_back(term);
+			plan.estimated_postings += term.posting_count;
+		}
 	}
-	//std::string word = text;
-	bool is_minus = false;
-	if (text[0] == '-') {
-		is_minus = true;
-		text = text.substr(1);
+	std::sort(plan.scored_terms.begin(), plan.scored_terms.end(),
+		[](const QueryPlan::Term& lhs, const QueryPlan::Term& rhs) {
+			return lhs.posting_count < rhs.posting_count;
+		});
+	if (query.posting_budget != 0 && query.mode == QueryMode::ANY && has_impact_index_) {
+		plan.posting_budget = query.posting_budget;
 	}
-	if (text.empty() || text[0] == '-' || !IsValidWord(text)) {
-		throw std::invalid_argument("Query word "s + static_cast<std::string>(text) + " is invalid");
+	if (query.stats != nullptr) {
+		query.stats->unknown_terms += plan.unknown_words.size();
 	}
-	return { text, is_minus, IsStopWord(text) };
+	return plan;
 }
 
-SearchServer::Query SearchServer::ParseQuery(std::string_view text, bool remove_duplicates) const {
+SearchServer::Query SearchServer::ParseQuery(std::string_view text, bool remove_duplicates,
+	const SearchOptions& options) const {
+	if (options.max_edit_distance < 0 || options.max_edit_distance > MAX_EDIT_DISTANCE) {
+		throw std::invalid_argument("Edit distance must be between 0 and "s + std::to_string(MAX_EDIT_DISTANCE));
+	}
+	if (options.mode == QueryMode::ALL && options.max_edit_distance > 0) {
+		throw std::invalid_argument("Fuzzy words are not supported with QueryMode::ALL"s);
+	}
+	StageTimer timer(options.stats != nullptr ? &options.stats->parse_time : nullptr);
 	Query result;
-	for (std::string_view word : SplitIntoWords(text)) {
-		const auto query_word = ParseQueryWord(word);
-		if (!query_word.is_stop) {
+	result.mode = options.mode;
+	result.posting_budget = options.posting_budget;
+	result.stats = options.stats;
+	result.cancellation = options.cancellation;
+	result.truncated = options.truncated;
+	size_t word_count = 0;
+	size_t stop_word_count = 0;
+	text_processor_.ForEachQueryWord(text, result.normalized_text, [&](const TextProcessor::QueryWord& query_word) {
+		++word_count;
+		stop_word_count += query_word.is_stop;
+		if (query_word.is_prefix && !query_word.is_minus && result.mode == QueryMode::ALL) {
+			throw std::invalid_argument("Prefix words are not supported with QueryMode::ALL"s);
+		}
+		if (query_word.is_prefix) {
+			ExpandPrefix(query_word.data, query_word.is_minus ? result.minus_words : result.plus_words);
+		}
+		else if (!query_word.is_stop) {
 			if (query_word.is_minus) {
 				result.minus_words.push_back(query_word.data);
 			}
+			else if (options.max_edit_distance > 0) {
+				ExpandFuzzy(query_word.data, options.max_edit_distance, result);
+			}
 			else {
 				result.plus_words.push_back(query_word.data);
 			}
 		}
-	}
+		});
 
 	if (remove_duplicates) {
-		std::sort(result.minus_words.begin(), result.minus_words.end());
-		result.minus_words.erase(std::unique(result.minus_words.begin(),
-			result.minus_words.end()), result.minus_words.end());
-
-		std::sort(result.plus_words.begin(), result.plus_words.end());
-		result.plus_words.erase(std::unique(result.plus_words.begin(),
-			result.plus_words.end()), result.plus_words.end());
-
+		TextProcessor::RemoveDuplicateWords(result.minus_words);
+		TextProcessor::RemoveDuplicateWords(result.plus_words);
+	}
+	if (result.stats != nullptr) {
+		result.stats->terms_parsed += word_count;
+		result.stats->stop_words += stop_word_count;
 	}
 
 	return result;
 }
 
+void SearchServer::ExpandPrefix(std::string_view prefix, std::vector<std::string_view>& terms) const {
+	size_t expanded = 0;
+	term_trie_.ForEachWithPrefix(prefix, [&](std::string_view term) {
+		// Terms stay in the dictionary after their last document is removed
+		if (!word_to_document_freqs_.at(term).empty()) {
+			terms.push_back(term);
+			++expanded;
+		}
+		return expanded < MAX_PREFIX_EXPANSION;
+		});
+}
+
+void SearchServer::ExpandFuzzy(std::string_view word, int max_edit_distance, Query& query) const {
+	const auto add_term = [&query](std::string_view term, double weight) {
+		const auto [it, inserted] = query.expansion_weights.emplace(term, weight);
+		if (!inserted) {
+			it->second = std::max(it->second, weight);
+		}
+		query.plus_words.push_back(term);
+	};
+	// The word itself is kept even when unknown so that the query still
+	// reports it as a plus word
+	add_term(word, 1.0);
+	// Terms one edit away are always found. The walk for the farther ones
+	// explores most of the upper trie levels, so it is cut off after
+	// MAX_FUZZY_VISITED_NODES nodes and may miss some of them.
+	auto terms = term_trie_.FindWithinDistance(word, std::min(max_edit_distance, 1));
+	if (max_edit_distance > 1) {
+		for (const auto& found : term_trie_.FindWithinDistance(word, max_edit_distance, MAX_FUZZY_VISITED_NODES)) {
+			if (found.second > 1) {
+				terms.push_back(found);
+			}
+		}
+	}
+	for (const auto& [term, distance] : terms) {
+		if (distance > 0 && !word_to_document_freqs_.at(term).empty()) {
+			add_term(term, 1.0 / (1 + distance));
+		}
+	}
+}
+
 double SearchServer::ComputeWordInverseDocumentFreq(std::string_view word) const {
 	return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
 }
 
-std::set<int, std::map<std::string, double>>::const_iterator SearchServer::begin() const {
+double SearchServer::ComputeWordInverseDocumentFreq(std::string_view word, const Query& query) const {
+	if (query.global_statistics != nullptr) {
+		const auto it = query.global_statistics->document_freqs.find(word);
+		if (it != query.global_statistics->document_freqs.end() && it->second > 0) {
+			return log(query.global_statistics->document_count * 1.0 / it->second);
+		}
+	}
+	return ComputeWordInverseDocumentFreq(word);
+}
+
+double SearchServer::ComputeWordWeight(std::string_view word, const Query& query) const {
+	const auto it = query.expansion_weights.find(word);
+	const double weight = ComputeWordInverseDocumentFreq(word, query);
+	return it == query.expansion_weights.end() ? weight : weight * it->second;
+}
+
+std::pmr::set<int>::const_iterator SearchServer::begin() const {
 	return document_ids_.begin();
 }
 
-std::set<int, std::map<std::string, double>>::const_iterator SearchServer::end() const {
+std::pmr::set<int>::const_iterator SearchServer::end() const {
 	return document_ids_.end();
 }
 
-const std::map<std::string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
-	static std::map<std::string_view, double> word_frequencies;
+const SearchServer::WordFrequencies& SearchServer::GetWordFrequencies(int document_id) const {
+	static const WordFrequencies word_frequencies;
 	if (document_ids_freqs_.count(document_id)) {
 		return document_ids_freqs_.at(document_id);
 	}
 	return word_frequencies;
 }
 
-void SearchServer::RemoveDocument(int document_id) {
-	for (auto& [i, container] : word_to_document_freqs_) {
-		container.erase(document_id);
+void SearchServer::UpdateDocument(int document_id, std::string_view document, DocumentStatus status,
+	const std::vector<int>& ratings) {
+	auto& word_freqs = GetIndexedWordFrequencies(document_id);
+	const uint32_t slot = document_attributes_.GetSlot(document_id);
+	DropImpactIndex();
+
+	// The text is not retained: words new to the dictionary are copied there
+	// and the forward index is keyed by the dictionary terms instead
+	std::string text(document);
+	const auto term_freqs = CountTermFrequencies(text_processor_.SplitIntoWordsNoStop(text));
+
+	// Both sides are sorted by word: walk them together and touch only the
+	// postings of words that appear, disappear or change frequency
+	auto old_it = word_freqs.begin();
+	auto new_it = term_freqs.begin();
+	while (old_it != word_freqs.end() || new_it != term_freqs.end()) {
+		if (new_it == term_freqs.end() || (old_it != word_freqs.end() && old_it->first < new_it->first)) {
+			word_to_document_freqs_.at(old_it->first).erase(slot);
+			old_it = word_freqs.erase(old_it);
+		}
+		else if (old_it == word_freqs.end() || new_it->first < old_it->first) {
+			word_freqs[AddPosting(slot, new_it->first, new_it->second, true)] += new_it->second;
+			++new_it;
+		}
+		else {
+			if (old_it->second != new_it->second) {
+				old_it->second = new_it->second;
+				word_to_document_freqs_.at(old_it->first).at(slot) = new_it->second;
+			}
+			++old_it;
+			++new_it;
+		}
 	}
-	document_ids_freqs_.erase(document_id);
-	documents_.erase(document_id);
-	document_ids_.erase(document_id);
 
+	UpdateStatus(document_id, status);
+	UpdateRating(document_id, ratings);
+}
+
+void SearchServer::UpdateStatus(int document_id, DocumentStatus status) {
+	document_attributes_.SetStatus(GetDocumentSlot(document_id), status);
+}
+
+void SearchServer::UpdateRating(int document_id, const std::vector<int>& ratings) {
+	document_attributes_.SetRating(GetDocumentSlot(document_id), ComputeAverageRating(ratings));
+}
+
+SearchServer::WordFrequencies& SearchServer::GetIndexedWordFrequencies(int document_id) {
+	const auto it = document_ids_freqs_.find(document_id);
+	if (it == document_ids_freqs_.end()) {
+		throw std::out_of_range("Document "s + std::to_string(document_id) + " is not found"s);
+	}
+	return it->second;
+}
+
+void SearchServer::RemoveDocument(int document_id) {
+	RemoveDocuments(std::execution::seq, { document_id });
 }
 
 void SearchServer::RemoveDocument(std::execution::sequenced_policy parallel, int document_id) {
@@ -204,6 +695,10 @@ void SearchServer::RemoveDocument(std::execution::sequenced_policy parallel, int
 }
 
 void SearchServer::RemoveDocument(std::execution::parallel_policy parallel, int document_id) {
+	if (!IsMemoryResourceSynchronized()) {
+		RemoveDocument(document_id);
+		return;
+	}
 	std::vector<const std::string_view*> words_;
 	words_.reserve(document_ids_freqs_.count(document_id));
 	//std::transform(parallel, document_ids_freqs_.at(document_id).begin(),
@@ -214,16 +709,88 @@ void SearchServer::RemoveDocument(std::execution::parallel_policy parallel, int
 	for (auto& [word, _] : document_ids_freqs_.at(document_id)) {
 		words_.push_back(&word);
 	}
+	const uint32_t slot = document_attributes_.GetSlot(document_id);
 	std::for_each(parallel, words_.begin(), words_.end(),
 		[&](auto& word) {
 			if (word_to_document_freqs_.count(*word) > 0) {
-				word_to_document_freqs_.at(*word).erase(document_id);
+				word_to_document_freqs_.at(*word).erase(slot);
 			}
 		});
-	document_ids_freqs_.erase(document_id);
-	documents_.erase(document_id);
-	document_ids_.erase(document_id);
+	EraseDocumentData(document_id);
+
+}
+
+void SearchServer::RemoveDocuments(const std::vector<int>& document_ids) {
+	RemoveDocuments(std::execution::seq, document_ids);
+}
+
+void SearchServer::RemoveDocuments(std::execution::sequenced_policy policy, const std::vector<int>& document_ids) {
+	EraseDocumentPostings(policy, document_ids);
+}
 
+void SearchServer::RemoveDocuments(std::execution::parallel_policy policy, const std::vector<int>& document_ids) {
+	if (IsMemoryResourceSynchronized()) {
+		EraseDocumentPostings(policy, document_ids);
+	}
+	else {
+		EraseDocumentPostings(std::execution::seq, document_ids);
+	}
+}
+
+bool SearchServer::IsMemoryResourceSynchronized() const {
+	const std::pmr::memory_resource* resource = word_to_document_freqs_.get_allocator().resource();
+	while (const auto* counting = dynamic_cast<const CountingMemoryResource*>(resource)) {
+		resource = counting->GetUpstream();
+	}
+	return resource == std::pmr::new_delete_resource()
+		|| dynamic_cast<const std::pmr::synchronized_pool_resource*>(resource) != nullptr;
+}
+
+template <typename ExecutionPolicy>
+void SearchServer::EraseDocumentPostings(ExecutionPolicy&& policy, const std::vector<int>& document_ids) {
+	std::vector<int> removed_ids;
+	removed_ids.reserve(document_ids.size());
+	for (const int document_id : document_ids) {
+		if (document_ids_freqs_.count(document_id) != 0) {
+			removed_ids.push_back(document_id);
+		}
+	}
+	std::sort(removed_ids.begin(), removed_ids.end());
+	removed_ids.erase(std::unique(removed_ids.begin(), removed_ids.end()), removed_ids.end());
+
+	// One pass over the forward index, then the removals sorted by posting
+	// list and, within a list, by slot
+	std::vector<std::pair<PostingList*, int>> removals;
+	for (const int document_id : removed_ids) {
+		const int slot = static_cast<int>(document_attributes_.GetSlot(document_id));
+		for (const auto& [word, _] : document_ids_freqs_.at(document_id)) {
+			removals.emplace_back(&word_to_document_freqs_.at(word), slot);
+		}
+	}
+	std::sort(removals.begin(), removals.end());
+
+	std::vector<std::pair<size_t, size_t>> groups;
+	for (size_t begin = 0; begin < removals.size();) {
+		size_t end = begin + 1;
+		while (end < removals.size() && removals[end].first == removals[begin].first) {
+			++end;
+		}
+		groups.emplace_back(begin, end);
+		begin = end;
+	}
+	// Every posting list belongs to one group, so the groups need no locking
+	std::for_each(policy, groups.begin(), groups.end(), [&removals](const std::pair<size_t, size_t>& group) {
+		std::vector<int> group_slots;
+		group_slots.reserve(group.second - group.first);
+		for (size_t i = group.first; i < group.second; ++i) {
+			group_slots.push_back(removals[i].second);
+		}
+		removals[group.first].first->EraseSorted(group_slots);
+		});
+
+	for (const int document_id : removed_ids) {
+		EraseDocumentData(document_id);
+	}
 }
 
 void AddDocument(SearchServer& search_server, int document_id, std::string_view document,
@@ -260,3 +827,24 @@ void MatchDocuments(const SearchServer& search_server, std::string_view query) {
 		std::cout << "Error in matchig request "s << static_cast<std::string>(query) << ": "s << e.what() << std::endl;
 	}
 }
+
+std::ostream& operator<<(std::ostream& out, const QueryPlan& plan) {
+	out << "mode = "s << (plan.mode == QueryMode::ALL ? "ALL"s : "ANY"s)
+		<< ", estimated postings = "s << plan.estimated_postings;
+	if (plan.posting_budget != 0) {
+		out << ", impact ordered, posting budget = "s << plan.posting_budget;
+	}
+	out << '\n';
+	for (const QueryPlan::Term& term : plan.scored_terms) {
+		out << "  scan "s << term.word << ": postings = "s << term.posting_count
+			<< ", weight = "s << term.weight << '\n';
+	}
+	for (const QueryPlan::Term& term : plan.zero_weight_terms) {
+		out << "  skip "s << term.word << ": postings = "s << term.posting_count << ", zero IDF"s << '\n';
+	}
+	for (const std::string& word : plan.unknown_words) {
+		out << "  unknown "s << word << '\n';
+	}
+	out << "  minus words = "s << plan.minus_word_count << '\n';
+	return out;
+}
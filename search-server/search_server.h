@@ -1,40 +1,180 @@
 #pragma once
 #include "string_processing.h"
-#include "concurrent_map.h"
+#include "cancellation.h"
+#include "counting_memory_resource.h"
+#include "document_attributes.h"
+#include "hybrid_posting_list.h"
+#include "impact_ordered_postings.h"
+#include "memory_stats.h"
+#include "query_stats.h"
+#include "term_trie.h"
+#include "text_processor.h"
 #include <utility>
 #include <algorithm>
+#include <atomic>
 #include <tuple>
 #include <map>
 #include <cmath>
+#include <limits>
 #include <numeric>
 #include <execution>
 #include <list>
 #include <future>
+#include <thread>
 #include <deque>
+#include <memory>
+#include <memory_resource>
+#include <type_traits>
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
 constexpr auto EPS = 1e-6;
-constexpr size_t THREAD_COUNT = 6;
+// Upper bound on the terms a prefix query word such as cat* expands to
+constexpr size_t MAX_PREFIX_EXPANSION = 64;
+constexpr int MAX_EDIT_DISTANCE = 2;
+// Upper bound on the trie nodes a fuzzy query word visits beyond one edit:
+// under 3 ms per word over a 1M-term vocabulary
+constexpr size_t MAX_FUZZY_VISITED_NODES = size_t{ 1 } << 15;
+// Scores accumulate in a dense per-thread array when a query may match at
+// least one document id in this many, otherwise in a map
+constexpr size_t DENSE_SCORES_MIN_DENSITY = 64;
+// The parallel scan splits the documents into ranges with about this many
+// postings of the query terms each
+constexpr size_t PARALLEL_CHUNK_POSTINGS = size_t{ 1 } << 14;
 
 using TapleWordsStatus = std::tuple<std::vector<std::string_view>, DocumentStatus>;
 
+// Corpus-wide statistics for the plus words of a query. Shards of a distributed
+// index exchange them so that every shard scores with the same global IDF.
+struct TermStatistics {
+	int document_count = 0;
+	std::map<std::string, int, std::less<>> document_freqs;
+};
+
+enum class QueryMode {
+	// Documents containing any plus word
+	ANY,
+	// Documents containing every plus word
+	ALL,
+};
+
+// Optional query behaviour of FindTopDocuments
+struct SearchOptions {
+	QueryMode mode = QueryMode::ANY;
+
+	// Plus words also match dictionary terms within this many edits, weighted
+	// by 1 / (1 + distance). Up to MAX_EDIT_DISTANCE, 0 turns fuzzy search off.
+	// Terms two edits away are searched within MAX_FUZZY_VISITED_NODES and may
+	// be missed on large vocabularies.
+	int max_edit_distance = 0;
+
+	// Approximate ranking with a latency bound: with the impact-ordered index
+	// built (SearchServer::BuildImpactIndex) at most this many postings are
+	// scored, highest impact first, and scoring stops earlier once no further
+	// posting can change which documents make the page. The documents of the
+	// page get their exact relevance. 0 ranks exactly, as do ALL queries.
+	size_t posting_budget = 0;
+
+	// Filled with the execution statistics of the query when set
+	QueryStats* stats = nullptr;
+
+	// Checked while scoring: once it fires, the search ranks the documents
+	// scored so far
+	const CancellationToken* cancellation = nullptr;
+	// Set to whether the cancellation cut the search short
+	bool* truncated = nullptr;
+};
+
+// How FindTopDocuments evaluates a query, see SearchServer::ExplainQuery
+struct QueryPlan {
+	struct Term {
+		std::string_view word;
+		size_t posting_count = 0;
+		double weight = 0;
+	};
+
+	QueryMode mode = QueryMode::ANY;
+	// Plus words scanned for relevance, shortest posting list first
+	std::vector<Term> scored_terms;
+	// Plus words with zero IDF: they only add documents with relevance 0,
+	// which are collected when the scored documents do not fill the page
+	std::vector<Term> zero_weight_terms;
+	// Plus words missing from the index
+	std::vector<std::string> unknown_words;
+	size_t minus_word_count = 0;
+	// Postings of the scored terms
+	size_t estimated_postings = 0;
+	// Postings scored in impact order before stopping, 0 when ranking exactly
+	size_t posting_budget = 0;
+};
+
+std::ostream& operator<<(std::ostream& out, const QueryPlan& plan);
+
 class SearchServer {
 public:
+	// The posting lists, forward index and document set take their memory
+	// from the memory resource given to the constructor
+	using PostingList = HybridPostingList;
+	using WordFrequencies = std::pmr::map<std::string_view, double>;
+
+	// The memory resource must outlive the server. A pool or arena resource
+	// turns the per-node heap allocations into a few large ones.
+	// RemoveDocument and RemoveDocuments with the parallel policy free posting
+	// memory from several threads, so they run in parallel only over a
+	// thread-safe resource: new_delete_resource, synchronized_pool_resource or
+	// a CountingMemoryResource over one of them. Over any other resource, such
+	// as unsynchronized_pool_resource or monotonic_buffer_resource, they erase
+	// sequentially.
 	template <typename StringContainer>
-	explicit SearchServer(const StringContainer& stop_words);
-	explicit SearchServer(std::string stop_words_text);
-	explicit SearchServer(std::string_view stop_words_text);
+	explicit SearchServer(const StringContainer& stop_words, TextAnalysis analysis = {},
+		std::pmr::memory_resource* memory_resource = std::pmr::get_default_resource());
+	explicit SearchServer(std::string stop_words_text, TextAnalysis analysis = {},
+		std::pmr::memory_resource* memory_resource = std::pmr::get_default_resource());
+	explicit SearchServer(std::string_view stop_words_text, TextAnalysis analysis = {},
+		std::pmr::memory_resource* memory_resource = std::pmr::get_default_resource());
 
 	void AddDocument(int document_id, std::string_view document, DocumentStatus status,
 		const std::vector<int>& ratings);
+	// Indexes a borrowed document without copying it: the text must stay valid
+	// while the owner is alive, and the server keeps the owner. Only terms new
+	// to the dictionary are copied. An empty owner means the text outlives the
+	// server. With TextAnalysis::fold_case the text is copied anyway, because
+	// it is normalized in place.
+	void AddDocument(int document_id, std::string_view document, DocumentStatus status,
+		const std::vector<int>& ratings, std::shared_ptr<const void> owner);
+
+	// Bulk loading splits AddDocument in two: ComputeTermFrequencies may run on
+	// several threads at once, AddAnalyzedDocument on one. The document text
+	// must already be normalized for the text analysis.
+	std::vector<std::pair<std::string_view, double>> ComputeTermFrequencies(std::string_view document) const;
+	// The words must stay valid while the owner is alive, as for a borrowed document
+	void AddAnalyzedDocument(int document_id, const std::vector<std::pair<std::string_view, double>>& term_freqs,
+		DocumentStatus status, const std::vector<int>& ratings, std::shared_ptr<const void> owner);
+
+	const TextAnalysis& GetTextAnalysis() const;
+
+	// Replaces the text, status and ratings of a document in place: only the
+	// postings of words that appear, disappear or change frequency are touched
+	void UpdateDocument(int document_id, std::string_view document, DocumentStatus status,
+		const std::vector<int>& ratings);
+	void UpdateStatus(int document_id, DocumentStatus status);
+	// Sets the average of the ratings as for AddDocument
+	void UpdateRating(int document_id, const std::vector<int>& ratings);
 
 	void RemoveDocument(int document_id);
 	void RemoveDocument(std::execution::sequenced_policy parallel, int document_id);
 	void RemoveDocument(std::execution::parallel_policy parallel, int document_id);
 
+	// Removes a batch in one pass over the forward index: the removals are
+	// grouped by word and every affected posting list is cleaned once, in
+	// parallel across words with the parallel policy. Unknown ids are skipped.
+	void RemoveDocuments(const std::vector<int>& document_ids);
+	void RemoveDocuments(std::execution::sequenced_policy policy, const std::vector<int>& document_ids);
+	void RemoveDocuments(std::execution::parallel_policy policy, const std::vector<int>& document_ids);
+
 	template <typename DocumentPredicate, typename ExecutionPolicy>
 	std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
 		DocumentPredicate document_predicate) const;
+	// Evaluates the predicate sequentially, it needs not be thread-safe
 	template <typename DocumentPredicate>
 	std::vector<Document> FindTopDocuments(std::string_view raw_query,
 		DocumentPredicate document_predicate) const;
@@ -47,13 +187,54 @@ public:
 	std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query) const;
 	std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
 
+	template <typename ExecutionPolicy>
+	std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
+		const DocumentFilter& filter) const;
+	std::vector<Document> FindTopDocuments(std::string_view raw_query, const DocumentFilter& filter) const;
+
+	// Page of the full ranking: documents at positions [offset, offset + limit)
+	template <typename DocumentPredicate, typename ExecutionPolicy>
+	std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
+		DocumentPredicate document_predicate, size_t offset, size_t limit) const;
+	template <typename ExecutionPolicy>
+	std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
+		DocumentStatus status, size_t offset, size_t limit) const;
+	std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status,
+		size_t offset, size_t limit) const;
+
+	template <typename DocumentPredicate, typename ExecutionPolicy>
+	std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
+		DocumentPredicate document_predicate, const SearchOptions& options) const;
+	template <typename ExecutionPolicy>
+	std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
+		DocumentStatus status, const SearchOptions& options) const;
+	std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status,
+		const SearchOptions& options) const;
+
+	std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status,
+		const TermStatistics& global_statistics) const;
+
+	TermStatistics GetTermStatistics(std::string_view raw_query) const;
+
+	QueryPlan ExplainQuery(std::string_view raw_query, const SearchOptions& options = {}) const;
+
+	// Builds a copy of every posting list ordered by impact, used by queries
+	// with SearchOptions::posting_budget. Adding, updating the text of or
+	// removing a document drops it.
+	void BuildImpactIndex();
+	bool HasImpactIndex() const;
+
 	int GetDocumentCount() const;
 
-	std::set<int, std::map<std::string, double>>::const_iterator begin() const;
+	// Estimated heap usage by index component, see MemoryStats. With a
+	// CountingMemoryResource the bytes allocated through it are also measured.
+	MemoryStats GetMemoryStats(size_t top_term_count = 10) const;
+
+	std::pmr::set<int>::const_iterator begin() const;
 
-	std::set<int, std::map<std::string, double>>::const_iterator end() const;
+	std::pmr::set<int>::const_iterator end() const;
 
-	const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
+	const WordFrequencies& GetWordFrequencies(int document_id) const;
 
 	TapleWordsStatus MatchDocument(std::string_view raw_query,
 		int document_id) const;
@@ -63,89 +244,341 @@ public:
 	TapleWordsStatus MatchDocument(std::execution::parallel_policy parallel,
 		std::string_view raw_query,
 		int document_id) const;
+
+	// Order of the ranking: relevance (equal within EPS), then rating, then id.
+	// Merging results from several indexes must use it to rank the same way.
+	static bool RanksBefore(const Document& lhs, const Document& rhs);
 private:
-	struct DocumentData {
-		int rating;
-		DocumentStatus status;
-		
+	// Filter given as a precomputed bitset of candidate document slots
+	struct CandidatePredicate {
+		const DocumentBitset* candidates;
+		size_t candidate_count;
 	};
 	
-	const std::set<std::string, std::less<>> stop_words_;
-	std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
-	std::map<int, DocumentData> documents_;
-	std::map<int, std::map<std::string_view, double>> document_ids_freqs_;
-	std::set<int> document_ids_;
+	const TextProcessor text_processor_;
+	std::pmr::map<std::string_view, PostingList> word_to_document_freqs_;
+	std::pmr::map<int, WordFrequencies> document_ids_freqs_;
+	std::pmr::set<int> document_ids_;
 	std::deque<std::string> words;
+	// Dictionary copies of the terms first seen in borrowed documents
+	std::deque<std::string> dictionary_terms_;
+	std::vector<std::shared_ptr<const void>> borrowed_owners_;
+	DocumentAttributes document_attributes_;
+	TermTrie term_trie_;
+	std::pmr::map<std::string_view, ImpactOrderedPostings> impact_postings_;
+	bool has_impact_index_ = false;
+
+	bool DocumentContainsWord(std::string_view word, int slot) const;
+	// Rebinds indexed words to the dictionary copies, which outlive the query text
+	void PointToDictionary(std::vector<std::string_view>& words) const;
+
+	void EraseDocumentData(int document_id);
+	// Whether the index memory may be allocated and freed from several threads
+	bool IsMemoryResourceSynchronized() const;
+	template <typename ExecutionPolicy>
+	void EraseDocumentPostings(ExecutionPolicy&& policy, const std::vector<int>& document_ids);
 
-	bool IsStopWord(std::string_view word) const;
-
-	static bool IsValidWord(std::string_view word);
-
-	std::vector<std::string_view> SplitIntoWordsNoStop(std::string_view text) const;
-
-	static int ComputeAverageRating(const std::vector<int>& ratings);
-
-	struct QueryWord {
-		std::string_view data;
-		bool is_minus;
-		bool is_stop;
-	};
-
-	QueryWord ParseQueryWord(std::string_view text) const;
+	DocumentStatus GetDocumentStatus(int document_id) const;
+	// Throws out_of_range for an unknown document
+	uint32_t GetDocumentSlot(int document_id) const;
 
+	template <typename DocumentPredicate>
+	bool PassesFilter(int slot, const DocumentPredicate& document_predicate) const;
+
+	SearchServer(TextProcessor text_processor, std::pmr::memory_resource* memory_resource);
+
+	void IndexDocument(int document_id, const std::vector<std::string_view>& document_words,
+		DocumentStatus status, const std::vector<int>& ratings, bool copy_new_terms);
+	// A term new to the dictionary is keyed by a copy when copy_new_term is
+	// set, otherwise by the document word itself. word_freqs is the forward
+	// index entry of the document, slot its number in the posting lists.
+	void IndexWord(int slot, std::string_view word, double term_freq, bool copy_new_term,
+		WordFrequencies& word_freqs);
+	// Adds the posting alone and returns the dictionary term of the word
+	std::string_view AddPosting(int slot, std::string_view word, double term_freq, bool copy_new_term);
+	void RetainOwner(std::shared_ptr<const void> owner);
+	// Called before the posting lists change
+	void DropImpactIndex();
+	// Sorted distinct words with their frequencies
+	static std::vector<std::pair<std::string_view, double>> CountTermFrequencies(
+		std::vector<std::string_view> document_words);
+	// Forward index entry, throws out_of_range for an unknown document
+	WordFrequencies& GetIndexedWordFrequencies(int document_id);
 
 	struct Query {
 		std::vector<std::string_view> plus_words;
 		std::vector<std::string_view> minus_words;
+		// IDF is taken from here instead of the local index when set
+		const TermStatistics* global_statistics = nullptr;
+		// Weights of the plus words found by fuzzy expansion, 1 when absent
+		std::map<std::string_view, double> expansion_weights;
+		// Normalized copy of the query text when normalization changes it
+		std::unique_ptr<std::string> normalized_text;
+		QueryMode mode = QueryMode::ANY;
+		size_t posting_budget = 0;
+		QueryStats* stats = nullptr;
+		const CancellationToken* cancellation = nullptr;
+		bool* truncated = nullptr;
 	};
 
-	Query ParseQuery(std::string_view text, bool remove_duplicates) const;
+	Query ParseQuery(std::string_view text, bool remove_duplicates, const SearchOptions& options = {}) const;
+	void ExpandPrefix(std::string_view prefix, std::vector<std::string_view>& terms) const;
+	void ExpandFuzzy(std::string_view word, int max_edit_distance, Query& query) const;
+
+	// Documents containing any minus word, resolved before scoring
+	DocumentBitset ComputeExcludedDocuments(const Query& query) const;
+
+	CandidatePredicate MakeStatusPredicate(DocumentStatus status) const;
+
+	// True when visiting the candidates through the forward index is cheaper
+	// than scanning the posting lists of the query
+	bool PreferCandidateScan(const QueryPlan& plan, const CandidatePredicate& predicate) const;
+	std::vector<Document> FindCandidateDocuments(const Query& query, const QueryPlan& plan,
+		const DocumentBitset& candidates, CancellationCheck& cancellation) const;
 
 	// Existence required
 	double ComputeWordInverseDocumentFreq(std::string_view word) const;
+	double ComputeWordInverseDocumentFreq(std::string_view word, const Query& query) const;
+	// IDF scaled by the expansion weight of the word
+	double ComputeWordWeight(std::string_view word, const Query& query) const;
+
+	// Looks up the document frequency of every plus word, drops the ones
+	// that cannot change relevance and orders the rest by posting length
+	QueryPlan PlanQuery(const Query& query) const;
+
+	template <typename DocumentPredicate, typename ExecutionPolicy>
+	std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, const Query& query,
+		DocumentPredicate document_predicate, size_t offset, size_t limit) const;
+	// Plans and ranks sequentially: the parallel scan is only used when the
+	// caller passes std::execution::par, since no threshold for choosing it
+	// automatically has been measured on a multi-core machine
+	std::vector<Document> FindTopDocumentsPlanned(const Query& query, const CandidatePredicate& predicate,
+		size_t offset, size_t limit) const;
+	template <typename DocumentPredicate, typename ExecutionPolicy>
+	std::vector<Document> RankDocuments(ExecutionPolicy&& policy, const Query& query, const QueryPlan& plan,
+		DocumentPredicate document_predicate, size_t offset, size_t limit) const;
+	// Adds the unmatched documents containing a zero-weight term with relevance 0
+	template <typename DocumentPredicate>
+	void AppendUnscoredDocuments(const Query& query, const QueryPlan& plan, const DocumentBitset& excluded_documents,
+		DocumentPredicate document_predicate, std::vector<Document>& matched_documents,
+		CancellationCheck& cancellation) const;
 
 	template <typename DocumentPredicate>
 	std::vector<Document> FindAllDocuments(std::execution::parallel_policy, const Query& query,
-		DocumentPredicate document_predicate) const;
+		const QueryPlan& plan, const DocumentBitset& excluded_documents, DocumentPredicate document_predicate,
+		CancellationCheck& cancellation) const;
 
 	template <typename DocumentPredicate>
 	std::vector<Document> FindAllDocuments(std::execution::sequenced_policy, const Query& query,
-		DocumentPredicate document_predicate) const;
+		const QueryPlan& plan, const DocumentBitset& excluded_documents, DocumentPredicate document_predicate,
+		CancellationCheck& cancellation) const;
+
+	// Score per document slot, only the touched entries are non-zero
+	struct DenseScores {
+		// is_touched states of the impact-ordered search, which scores only
+		// the documents passing the filter: 0 is untouched
+		static constexpr uint8_t ACCEPTED = 1;
+		static constexpr uint8_t REJECTED = 2;
+
+		std::vector<double> scores;
+		std::vector<uint8_t> is_touched;
+		std::vector<int> touched;
+
+		void Reset();
+	};
+
+	// Scores the intersection of the plus word posting lists, driven by the
+	// shortest list
+	template <typename DocumentPredicate>
+	std::vector<Document> FindAllDocumentsConjunctive(const Query& query, const QueryPlan& plan,
+		const DocumentBitset& excluded_documents, DocumentPredicate document_predicate,
+		CancellationCheck& cancellation) const;
+
+	static DenseScores& GetThreadDenseScores();
+	// True when no document outside the top_count best accepted scores can
+	// overtake them by gaining at most remaining_impact
+	static bool IsTopStable(const DenseScores& dense, size_t top_count, double remaining_impact,
+		std::vector<double>& scores);
+	bool PreferDenseScores(const QueryPlan& plan) const;
+
+	template <typename DocumentPredicate>
+	std::vector<Document> FindAllDocumentsDense(const Query& query, const QueryPlan& plan,
+		const DocumentBitset& excluded_documents, DocumentPredicate document_predicate,
+		CancellationCheck& cancellation) const;
+
+	// Score-at-a-time evaluation over the impact-ordered postings: blocks
+	// are scored highest query impact first until the plan's posting budget
+	// runs out or the top_count best documents are settled. Returns those
+	// documents with their exact relevance.
+	template <typename DocumentPredicate>
+	std::vector<Document> FindImpactOrderedDocuments(const Query& query, const QueryPlan& plan,
+		const DocumentBitset& excluded_documents, DocumentPredicate document_predicate, size_t top_count,
+		CancellationCheck& cancellation) const;
+	// Relevance of a document computed from the forward index
+	double ComputeRelevance(int document_id, const QueryPlan& plan) const;
 };
 
 template <typename StringContainer>
-SearchServer::SearchServer(const StringContainer& stop_words)
-	: stop_words_(MakeUniqueNonEmptyStrings(stop_words))  // Extract non-empty stop words
-{
-	using namespace std::string_literals;
-	if (!all_of(stop_words_.begin(), stop_words_.end(), IsValidWord)) {
-		throw std::invalid_argument("Some of stop words are invalid"s);
-	}
+SearchServer::SearchServer(const StringContainer& stop_words, TextAnalysis analysis,
+	std::pmr::memory_resource* memory_resource)
+	: SearchServer(TextProcessor(stop_words, analysis), memory_resource) {
 }
 
 template <typename DocumentPredicate>
 std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query,
 	DocumentPredicate document_predicate) const {
-	return FindTopDocuments(std::execution::seq, raw_query, document_predicate);
+	const auto query = ParseQuery(raw_query, true);
+	return FindTopDocuments(std::execution::seq, query, document_predicate, 0, MAX_RESULT_DOCUMENT_COUNT);
 }
 
 template <typename DocumentPredicate, typename ExecutionPolicy>
 std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
 	DocumentPredicate document_predicate) const {
+	return FindTopDocuments(policy, raw_query, document_predicate, 0, MAX_RESULT_DOCUMENT_COUNT);
+}
+
+template <typename DocumentPredicate, typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
+	DocumentPredicate document_predicate, size_t offset, size_t limit) const {
 	const auto query = ParseQuery(raw_query, true);
+	return FindTopDocuments(policy, query, document_predicate, offset, limit);
+}
 
-	auto matched_documents = FindAllDocuments(policy, query, document_predicate);
+template <typename DocumentPredicate, typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
+	DocumentPredicate document_predicate, const SearchOptions& options) const {
+	const auto query = ParseQuery(raw_query, true, options);
+	return FindTopDocuments(policy, query, document_predicate, 0, MAX_RESULT_DOCUMENT_COUNT);
+}
 
-	sort(policy, matched_documents.begin(), matched_documents.end(),
-		[](const Document& lhs, const Document& rhs) {
-			return lhs.relevance > rhs.relevance
-				|| (std::abs(lhs.relevance - rhs.relevance) < EPS && lhs.rating > rhs.rating);
-		});
-	if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-		matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+template <typename DocumentPredicate, typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, const Query& query,
+	DocumentPredicate document_predicate, size_t offset, size_t limit) const {
+	return RankDocuments(policy, query, PlanQuery(query), document_predicate, offset, limit);
+}
+
+template <typename DocumentPredicate, typename ExecutionPolicy>
+std::vector<Document> SearchServer::RankDocuments(ExecutionPolicy&& policy, const Query& query, const QueryPlan& plan,
+	DocumentPredicate document_predicate, size_t offset, size_t limit) const {
+	// Positions of the ranking the page needs, saturated for an unbounded limit
+	const size_t ranked_count = limit > std::numeric_limits<size_t>::max() - offset
+		? std::numeric_limits<size_t>::max() : offset + limit;
+	CancellationCheck cancellation(query.cancellation);
+	if (query.truncated != nullptr) {
+		*query.truncated = cancellation.Check();
+	}
+	if ((plan.mode == QueryMode::ALL && !plan.unknown_words.empty()) || cancellation.IsCancelled()) {
+		return {};
+	}
+	QueryStats* const stats = query.stats;
+	bool scan_candidates = false;
+	if constexpr (std::is_same_v<DocumentPredicate, CandidatePredicate>) {
+		scan_candidates = plan.mode == QueryMode::ANY && plan.posting_budget == 0
+			&& PreferCandidateScan(plan, document_predicate);
+	}
+	// The candidate scan checks minus words in the forward index instead
+	DocumentBitset excluded_documents;
+	if (!scan_candidates) {
+		StageTimer timer(stats != nullptr ? &stats->exclude_time : nullptr);
+		excluded_documents = ComputeExcludedDocuments(query);
+		if (stats != nullptr) {
+			stats->documents_excluded += excluded_documents.Count();
+		}
+	}
+
+	std::vector<Document> matched_documents;
+	{
+		StageTimer timer(stats != nullptr ? &stats->score_time : nullptr);
+		if (plan.mode == QueryMode::ALL) {
+			if (!plan.scored_terms.empty()) {
+				matched_documents = FindAllDocumentsConjunctive(query, plan, excluded_documents, document_predicate,
+					cancellation);
+			}
+		}
+		else if (plan.posting_budget != 0) {
+			matched_documents = FindImpactOrderedDocuments(query, plan, excluded_documents, document_predicate,
+				ranked_count, cancellation);
+		}
+		else if (scan_candidates) {
+			if constexpr (std::is_same_v<DocumentPredicate, CandidatePredicate>) {
+				matched_documents = FindCandidateDocuments(query, plan, *document_predicate.candidates, cancellation);
+			}
+		}
+		else {
+			matched_documents = FindAllDocuments(policy, query, plan, excluded_documents, document_predicate,
+				cancellation);
+		}
+		if (stats != nullptr) {
+			stats->documents_scored += matched_documents.size();
+		}
+
+		// Documents matched only by zero-weight terms rank after every scored
+		// one, so they are needed only when the scored ones do not fill the page
+		if (!plan.zero_weight_terms.empty() && !cancellation.IsCancelled() && (plan.mode == QueryMode::ALL ? plan.scored_terms.empty()
+			: static_cast<size_t>(std::count_if(matched_documents.begin(), matched_documents.end(),
+				[](const Document& document) { return document.relevance >= EPS; })) < ranked_count)) {
+			if (scan_candidates) {
+				excluded_documents = ComputeExcludedDocuments(query);
+			}
+			AppendUnscoredDocuments(query, plan, excluded_documents, document_predicate, matched_documents,
+				cancellation);
+		}
+		if (stats != nullptr) {
+			stats->candidates += matched_documents.size();
+		}
+	}
+	if (query.truncated != nullptr) {
+		*query.truncated = cancellation.IsCancelled();
 	}
+
+	StageTimer timer(stats != nullptr ? &stats->sort_time : nullptr);
+	if (offset >= matched_documents.size()) {
+		return {};
+	}
+	// Only the first offset + limit positions of the ranking are ordered
+	const auto page_end = matched_documents.begin() + std::min(matched_documents.size() - offset, limit) + offset;
+	if (page_end != matched_documents.end()) {
+		nth_element(policy, matched_documents.begin(), page_end, matched_documents.end(), RanksBefore);
+	}
+	sort(policy, matched_documents.begin(), page_end, RanksBefore);
+	matched_documents.erase(page_end, matched_documents.end());
+	matched_documents.erase(matched_documents.begin(), matched_documents.begin() + offset);
 	return matched_documents;
 }
+
+template <typename DocumentPredicate>
+void SearchServer::AppendUnscoredDocuments(const Query& query, const QueryPlan& plan,
+	const DocumentBitset& excluded_documents, DocumentPredicate document_predicate,
+	std::vector<Document>& matched_documents, CancellationCheck& cancellation) const {
+	DocumentBitset seen_documents = excluded_documents;
+	for (const Document& document : matched_documents) {
+		seen_documents.Set(document_attributes_.GetSlot(document.id));
+	}
+	size_t posting_count = 0;
+	size_t predicate_evaluations = 0;
+	for (const QueryPlan::Term& term : plan.zero_weight_terms) {
+		for (const auto [slot, term_freq] : word_to_document_freqs_.at(term.word)) {
+			if (cancellation.Poll()) {
+				break;
+			}
+			++posting_count;
+			if (seen_documents.Test(slot)) {
+				continue;
+			}
+			++predicate_evaluations;
+			if (PassesFilter(slot, document_predicate)) {
+				seen_documents.Set(slot);
+				matched_documents.push_back({ document_attributes_.GetDocumentId(slot), 0.0,
+					document_attributes_.GetRating(slot) });
+			}
+		}
+	}
+	if (query.stats != nullptr) {
+		query.stats->postings_scanned += posting_count;
+		query.stats->predicate_evaluations += predicate_evaluations;
+	}
+}
+
 template <typename ExecutionPolicy>
 std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query) const {
 	return FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL);
@@ -153,76 +586,412 @@ std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, s
 
 template <typename ExecutionPolicy>
 std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, DocumentStatus status) const {
-	return FindTopDocuments(
-		policy, raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-			return document_status == status;
-		});
+	return FindTopDocuments(policy, raw_query, MakeStatusPredicate(status));
+}
+
+template <typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
+	DocumentStatus status, size_t offset, size_t limit) const {
+	return FindTopDocuments(policy, raw_query, MakeStatusPredicate(status), offset, limit);
+}
+
+template <typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
+	DocumentStatus status, const SearchOptions& options) const {
+	return FindTopDocuments(policy, raw_query, MakeStatusPredicate(status), options);
+}
+
+template <typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
+	const DocumentFilter& filter) const {
+	const DocumentBitset candidates = document_attributes_.Filter(filter);
+	return FindTopDocuments(policy, raw_query, CandidatePredicate{ &candidates, candidates.Count() });
+}
+
+template <typename DocumentPredicate>
+bool SearchServer::PassesFilter(int slot, const DocumentPredicate& document_predicate) const {
+	if constexpr (std::is_same_v<DocumentPredicate, CandidatePredicate>) {
+		return document_predicate.candidates->Test(slot);
+	}
+	else {
+		return document_predicate(document_attributes_.GetDocumentId(slot), document_attributes_.GetStatus(slot),
+			document_attributes_.GetRating(slot));
+	}
 }
 
 template <typename DocumentPredicate>
 std::vector<Document> SearchServer::FindAllDocuments(std::execution::parallel_policy, const Query& query,
-	DocumentPredicate document_predicate) const {
-	ConcurrentMap<int, double> document_to_relevance(THREAD_COUNT);
-	for_each(std::execution::par, query.plus_words.begin(), query.plus_words.end(),
-		[&](auto& word) {
-			if (word_to_document_freqs_.count(word) != 0) {
-				const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-				for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-					const auto& document_data = documents_.at(document_id);
-					if (document_predicate(document_id, document_data.status, document_data.rating)) {
-						document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
+	const QueryPlan& plan, const DocumentBitset& excluded_documents, DocumentPredicate document_predicate,
+	CancellationCheck& cancellation) const {
+	// The slots are cut into ranges holding about PARALLEL_CHUNK_POSTINGS
+	// postings of all the terms together. The boundaries are sampled from the
+	// positions of the longest posting list, so ranges follow where the
+	// postings are rather than splitting the slots evenly. Workers take the
+	// ranges one at a time, so a long posting list is shared by all of them,
+	// and a range owns the scores of its documents without locking.
+	const size_t slot_bound = document_attributes_.GetSlotBound();
+	if (slot_bound == 0 || plan.scored_terms.empty()) {
+		return {};
+	}
+	std::vector<const PostingList*> term_postings;
+	term_postings.reserve(plan.scored_terms.size());
+	size_t total_postings = 0;
+	for (const QueryPlan::Term& term : plan.scored_terms) {
+		term_postings.push_back(&word_to_document_freqs_.at(term.word));
+		total_postings += term_postings.back()->size();
+	}
+	const PostingList& longest_postings = **std::max_element(term_postings.begin(), term_postings.end(),
+		[](const PostingList* lhs, const PostingList* rhs) {
+			return lhs->size() < rhs->size();
+		});
+	const size_t sample_step = std::max<size_t>(1,
+		longest_postings.size() / std::max<size_t>(1, total_postings / PARALLEL_CHUNK_POSTINGS));
+	std::vector<int> range_bounds = longest_postings.SampleIds(sample_step);
+	range_bounds.insert(range_bounds.begin(), 0);
+	range_bounds.push_back(static_cast<int>(slot_bound));
+	const size_t range_count = range_bounds.size() - 1;
+	const size_t worker_count = std::min<size_t>(range_count, std::max(1u, std::thread::hardware_concurrency()));
+
+	std::atomic<size_t> next_range = 0;
+	std::atomic<size_t> posting_count = 0;
+	std::atomic<size_t> predicate_evaluations = 0;
+	std::atomic<bool> cancelled = false;
+	std::vector<std::vector<Document>> worker_documents(worker_count);
+	std::for_each(std::execution::par, worker_documents.begin(), worker_documents.end(),
+		[&](std::vector<Document>& matched_documents) {
+			CancellationCheck worker_cancellation(cancellation.GetToken());
+			std::vector<double> scores;
+			std::vector<uint8_t> is_touched;
+			std::vector<int> touched;
+			size_t worker_postings = 0;
+			size_t worker_evaluations = 0;
+			for (size_t range = next_range++; range < range_count && !cancelled.load(std::memory_order_relaxed);
+				range = next_range++) {
+				const int range_begin = range_bounds[range];
+				const int range_end = range_bounds[range + 1];
+				if (scores.size() < static_cast<size_t>(range_end - range_begin)) {
+					scores.resize(range_end - range_begin);
+					is_touched.resize(range_end - range_begin);
+				}
+				// Terms in plan order, so that relevance adds up as in the sequential scan
+				for (size_t i = 0; i < term_postings.size() && !worker_cancellation.IsCancelled(); ++i) {
+					const PostingList& postings = *term_postings[i];
+					const double weight = plan.scored_terms[i].weight;
+					auto cursor = postings.begin();
+					postings.SkipTo(cursor, range_begin);
+					for (; cursor != postings.end(); ++cursor) {
+						const auto [slot, term_freq] = *cursor;
+						if (slot >= range_end) {
+							break;
+						}
+						if (worker_cancellation.Poll()) {
+							cancelled.store(true, std::memory_order_relaxed);
+							break;
+						}
+						++worker_postings;
+						if (excluded_documents.Test(slot)) {
+							continue;
+						}
+						++worker_evaluations;
+						if (PassesFilter(slot, document_predicate)) {
+							const size_t offset = slot - range_begin;
+							if (!is_touched[offset]) {
+								is_touched[offset] = 1;
+								touched.push_back(slot);
+							}
+							scores[offset] += term_freq * weight;
+						}
 					}
 				}
-			}
-		});
-	for_each(std::execution::par, query.minus_words.begin(), query.minus_words.end(),
-		[&](auto& word) {
-			if (word_to_document_freqs_.count(word) != 0) {
-				for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-					document_to_relevance.erase(document_id);
+				for (const int slot : touched) {
+					const size_t offset = slot - range_begin;
+					matched_documents.push_back({ document_attributes_.GetDocumentId(slot), scores[offset],
+						document_attributes_.GetRating(slot) });
+					scores[offset] = 0;
+					is_touched[offset] = 0;
 				}
+				touched.clear();
 			}
+			posting_count.fetch_add(worker_postings, std::memory_order_relaxed);
+			predicate_evaluations.fetch_add(worker_evaluations, std::memory_order_relaxed);
 		});
+	if (cancelled.load()) {
+		cancellation.MarkCancelled();
+	}
+	if (query.stats != nullptr) {
+		query.stats->postings_scanned += posting_count.load();
+		query.stats->predicate_evaluations += predicate_evaluations.load();
+	}
+
+	std::vector<Document> matched_documents = std::move(worker_documents.front());
+	for (size_t worker = 1; worker < worker_count; ++worker) {
+		matched_documents.insert(matched_documents.end(), worker_documents[worker].begin(),
+			worker_documents[worker].end());
+	}
+	return matched_documents;
+}
 
-	auto result = document_to_relevance.BuildOrdinaryMap();
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindAllDocuments(std::execution::sequenced_policy, const Query& query,
+	const QueryPlan& plan, const DocumentBitset& excluded_documents, DocumentPredicate document_predicate,
+	CancellationCheck& cancellation) const {
+	if (PreferDenseScores(plan)) {
+		return FindAllDocumentsDense(query, plan, excluded_documents, document_predicate, cancellation);
+	}
+	std::map<int, double> document_to_relevance;
+	size_t posting_count = 0;
+	size_t predicate_evaluations = 0;
+	for (const QueryPlan::Term& term : plan.scored_terms) {
+		for (const auto [slot, term_freq] : word_to_document_freqs_.at(term.word)) {
+			if (cancellation.Poll()) {
+				break;
+			}
+			++posting_count;
+			if (excluded_documents.Test(slot)) {
+				continue;
+			}
+			++predicate_evaluations;
+			if (PassesFilter(slot, document_predicate)) {
+				document_to_relevance[slot] += term_freq * term.weight;
+			}
+		}
+	}
+	if (query.stats != nullptr) {
+		query.stats->postings_scanned += posting_count;
+		query.stats->predicate_evaluations += predicate_evaluations;
+	}
 
 	std::vector<Document> matched_documents;
-	for (const auto [document_id, relevance] : result) {
+	for (const auto [slot, relevance] : document_to_relevance) {
 		matched_documents.push_back(
-			{ document_id, relevance, documents_.at(document_id).rating });
+			{ document_attributes_.GetDocumentId(slot), relevance, document_attributes_.GetRating(slot) });
 	}
 	return matched_documents;
 }
 
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(std::execution::sequenced_policy, const Query& query,
-	DocumentPredicate document_predicate) const {
-	std::map<int, double> document_to_relevance;
-	for (auto word : query.plus_words) {
-		if (word_to_document_freqs_.count(word) == 0) {
+std::vector<Document> SearchServer::FindAllDocumentsConjunctive(const Query& query, const QueryPlan& plan,
+	const DocumentBitset& excluded_documents, DocumentPredicate document_predicate,
+	CancellationCheck& cancellation) const {
+	struct Term {
+		const PostingList* postings;
+		double weight;
+		PostingList::const_iterator cursor;
+	};
+	// The plan lists the terms shortest posting list first
+	std::vector<Term> terms;
+	terms.reserve(plan.scored_terms.size());
+	for (const QueryPlan::Term& term : plan.scored_terms) {
+		const auto& postings = word_to_document_freqs_.at(term.word);
+		terms.push_back({ &postings, term.weight, postings.begin() });
+	}
+
+	std::vector<Document> matched_documents;
+	size_t posting_count = 0;
+	size_t predicate_evaluations = 0;
+	for (const auto [slot, term_freq] : *terms.front().postings) {
+		if (cancellation.Poll()) {
+			break;
+		}
+		++posting_count;
+		if (excluded_documents.Test(slot)) {
 			continue;
 		}
-		const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-		for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-			const auto& document_data = documents_.at(document_id);
-			if (document_predicate(document_id, document_data.status, document_data.rating)) {
-				document_to_relevance[document_id] += term_freq * inverse_document_freq;
+		double relevance = term_freq * terms.front().weight;
+		bool in_all = true;
+		bool exhausted = false;
+		for (size_t i = 1; i < terms.size() && in_all; ++i) {
+			Term& term = terms[i];
+			term.postings->SkipTo(term.cursor, slot);
+			++posting_count;
+			if (term.cursor == term.postings->end()) {
+				exhausted = true;
+				break;
+			}
+			in_all = term.cursor->first == slot;
+			if (in_all) {
+				relevance += term.cursor->second * term.weight;
 			}
 		}
-	}
-	for (auto word : query.minus_words) {
-		if (word_to_document_freqs_.count(word) == 0) {
-			continue;
+		if (exhausted) {
+			break;
+		}
+		if (in_all) {
+			++predicate_evaluations;
+			if (PassesFilter(slot, document_predicate)) {
+				matched_documents.push_back({ document_attributes_.GetDocumentId(slot), relevance,
+					document_attributes_.GetRating(slot) });
+			}
 		}
-		for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-			document_to_relevance.erase(document_id);
+	}
+	if (query.stats != nullptr) {
+		query.stats->postings_scanned += posting_count;
+		query.stats->predicate_evaluations += predicate_evaluations;
+	}
+	return matched_documents;
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindAllDocumentsDense(const Query& query, const QueryPlan& plan,
+	const DocumentBitset& excluded_documents, DocumentPredicate document_predicate,
+	CancellationCheck& cancellation) const {
+	DenseScores& dense = GetThreadDenseScores();
+	// Entries left by a query interrupted with an exception
+	dense.Reset();
+	const size_t slot_bound = document_attributes_.GetSlotBound();
+	if (dense.scores.size() < slot_bound) {
+		dense.scores.resize(slot_bound);
+		dense.is_touched.resize(slot_bound);
+	}
+
+	size_t posting_count = 0;
+	size_t predicate_evaluations = 0;
+	for (const QueryPlan::Term& term : plan.scored_terms) {
+		for (const auto [slot, term_freq] : word_to_document_freqs_.at(term.word)) {
+			if (cancellation.Poll()) {
+				break;
+			}
+			++posting_count;
+			if (excluded_documents.Test(slot)) {
+				continue;
+			}
+			++predicate_evaluations;
+			if (PassesFilter(slot, document_predicate)) {
+				if (!dense.is_touched[slot]) {
+					dense.is_touched[slot] = 1;
+					dense.touched.push_back(slot);
+				}
+				dense.scores[slot] += term_freq * term.weight;
+			}
 		}
 	}
+	if (query.stats != nullptr) {
+		query.stats->postings_scanned += posting_count;
+		query.stats->predicate_evaluations += predicate_evaluations;
+	}
 
 	std::vector<Document> matched_documents;
-	for (const auto [document_id, relevance] : document_to_relevance) {
+	matched_documents.reserve(dense.touched.size());
+	for (const int slot : dense.touched) {
 		matched_documents.push_back(
-			{ document_id, relevance, documents_.at(document_id).rating });
+			{ document_attributes_.GetDocumentId(slot), dense.scores[slot], document_attributes_.GetRating(slot) });
+	}
+	dense.Reset();
+	return matched_documents;
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindImpactOrderedDocuments(const Query& query, const QueryPlan& plan,
+	const DocumentBitset& excluded_documents, DocumentPredicate document_predicate, size_t top_count,
+	CancellationCheck& cancellation) const {
+	struct Term {
+		const ImpactOrderedPostings* postings;
+		double weight;
+		size_t block;
+		// Next posting to score within the block
+		const ImpactOrderedPostings::Posting* position;
+
+		double GetImpact() const {
+			return postings->GetBlockImpact(block) * weight;
+		}
+	};
+	std::vector<Term> terms;
+	terms.reserve(plan.scored_terms.size());
+	// Upper bound of what the unscored postings can still add to a document
+	double remaining_impact = 0;
+	for (const QueryPlan::Term& term : plan.scored_terms) {
+		const ImpactOrderedPostings& postings = impact_postings_.at(term.word);
+		terms.push_back({ &postings, term.weight, 0, postings.GetBlockBegin(0) });
+		remaining_impact += terms.back().GetImpact();
+	}
+	const auto by_impact = [&terms](size_t lhs, size_t rhs) {
+		return terms[lhs].GetImpact() < terms[rhs].GetImpact();
+	};
+	std::vector<size_t> heap(terms.size());
+	std::iota(heap.begin(), heap.end(), 0);
+	std::make_heap(heap.begin(), heap.end(), by_impact);
+
+	DenseScores& dense = GetThreadDenseScores();
+	dense.Reset();
+	const size_t slot_bound = document_attributes_.GetSlotBound();
+	if (dense.scores.size() < slot_bound) {
+		dense.scores.resize(slot_bound);
+		dense.is_touched.resize(slot_bound);
+	}
+
+	std::vector<double> scores;
+	size_t posting_count = 0;
+	size_t predicate_evaluations = 0;
+	// The stability check is linear in the touched documents, so it waits
+	// for as many postings to be scored
+	size_t unchecked_postings = 0;
+	while (!heap.empty() && posting_count < plan.posting_budget && !cancellation.IsCancelled()) {
+		std::pop_heap(heap.begin(), heap.end(), by_impact);
+		Term& term = terms[heap.back()];
+		const ImpactOrderedPostings::Posting* const block_end = term.postings->GetBlockEnd(term.block);
+		const size_t block_postings = std::min<size_t>(block_end - term.position, plan.posting_budget - posting_count);
+		size_t scored_postings = 0;
+		for (; scored_postings < block_postings && !cancellation.Poll(); ++scored_postings) {
+			const ImpactOrderedPostings::Posting* const posting = term.position + scored_postings;
+			const int slot = posting->slot;
+			uint8_t& state = dense.is_touched[slot];
+			if (state == 0) {
+				dense.touched.push_back(slot);
+				state = DenseScores::REJECTED;
+				if (!excluded_documents.Test(slot)) {
+					++predicate_evaluations;
+					if (PassesFilter(slot, document_predicate)) {
+						state = DenseScores::ACCEPTED;
+					}
+				}
+			}
+			if (state == DenseScores::ACCEPTED) {
+				dense.scores[slot] += posting->term_freq * term.weight;
+			}
+		}
+		posting_count += scored_postings;
+		unchecked_postings += scored_postings;
+		term.position += scored_postings;
+		if (term.position != block_end) {
+			break;
+		}
+
+		remaining_impact -= term.GetImpact();
+		if (++term.block < term.postings->GetBlockCount()) {
+			term.position = term.postings->GetBlockBegin(term.block);
+			remaining_impact += term.GetImpact();
+			std::push_heap(heap.begin(), heap.end(), by_impact);
+		}
+		else {
+			heap.pop_back();
+		}
+		if (unchecked_postings >= dense.touched.size()) {
+			unchecked_postings = 0;
+			if (IsTopStable(dense, top_count, std::max(remaining_impact, 0.0), scores)) {
+				break;
+			}
+		}
+	}
+
+	std::vector<Document> matched_documents;
+	for (const int slot : dense.touched) {
+		if (dense.is_touched[slot] == DenseScores::ACCEPTED) {
+			matched_documents.push_back({ document_attributes_.GetDocumentId(slot), dense.scores[slot],
+				document_attributes_.GetRating(slot) });
+		}
+	}
+	dense.Reset();
+	if (matched_documents.size() > top_count) {
+		std::nth_element(matched_documents.begin(), matched_documents.begin() + top_count, matched_documents.end(),
+			RanksBefore);
+		matched_documents.resize(top_count);
+	}
+	for (Document& document : matched_documents) {
+		document.relevance = ComputeRelevance(document.id, plan);
+	}
+	if (query.stats != nullptr) {
+		query.stats->postings_scanned += posting_count + matched_documents.size() * plan.scored_terms.size();
+		query.stats->predicate_evaluations += predicate_evaluations;
 	}
 	return matched_documents;
 }
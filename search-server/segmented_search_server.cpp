@@ -0,0 +1,222 @@
+#include "segmented_search_server.h"
+
+using namespace std::string_literals;
+
+SegmentedSearchServer::SegmentedSearchServer(std::string_view stop_words_text, SegmentedIndexOptions options)
+    : options_(options)
+    , text_processor_(stop_words_text, options.analysis) {
+    if (options_.max_mutable_documents == 0 || options_.merge_factor < 2) {
+        throw std::invalid_argument("Invalid segmented index options"s);
+    }
+    merge_thread_ = std::thread([this] {
+        MergeLoop();
+        });
+}
+
+SegmentedSearchServer::~SegmentedSearchServer() {
+    {
+        std::lock_guard guard(merge_mutex_);
+        stopping_ = true;
+    }
+    merge_requested_cv_.notify_all();
+    merge_thread_.join();
+}
+
+void SegmentedSearchServer::AddDocument(int document_id, std::string_view document, DocumentStatus status,
+    const std::vector<int>& ratings) {
+    // The segment copies the words, so a normalized copy of the text only has
+    // to live until then
+    std::string normalized_text;
+    std::vector<std::string_view> words;
+    if (options_.analysis.fold_case) {
+        normalized_text = document;
+        words = text_processor_.SplitIntoWordsNoStop(normalized_text);
+    }
+    else {
+        words = text_processor_.SplitIntoWordsNoStop(document);
+    }
+    const int rating = ComputeAverageRating(ratings);
+
+    bool sealed = false;
+    {
+        std::unique_lock guard(mutex_);
+        if (document_id < 0 || document_ids_.count(document_id) > 0) {
+            throw std::invalid_argument("Invalid document_id"s);
+        }
+        mutable_segment_.AddDocument({ document_id, rating, status }, words);
+        document_ids_.insert(document_id);
+        if (mutable_segment_.GetDocumentCount() >= options_.max_mutable_documents) {
+            SealMutableSegment();
+            sealed = true;
+        }
+    }
+    if (sealed) {
+        RequestMerge();
+    }
+}
+
+void SegmentedSearchServer::RemoveDocument(int document_id) {
+    std::unique_lock guard(mutex_);
+    if (document_ids_.erase(document_id) == 0) {
+        return;
+    }
+    if (mutable_segment_.RemoveDocument(document_id)) {
+        return;
+    }
+    for (const auto& segment : segments_) {
+        if (segment->RemoveDocument(document_id)) {
+            break;
+        }
+    }
+}
+
+std::vector<Document> SegmentedSearchServer::FindTopDocuments(std::string_view raw_query, DocumentStatus status) const {
+    return FindTopDocuments(raw_query, [status](int, DocumentStatus document_status, int) {
+        return document_status == status;
+        });
+}
+
+std::vector<Document> SegmentedSearchServer::FindTopDocuments(std::string_view raw_query) const {
+    return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
+}
+
+int SegmentedSearchServer::GetDocumentCount() const {
+    std::shared_lock guard(mutex_);
+    return document_ids_.size();
+}
+
+size_t SegmentedSearchServer::GetSegmentCount() const {
+    std::shared_lock guard(mutex_);
+    return segments_.size();
+}
+
+size_t SegmentedSearchServer::GetSegmentMemoryUsage() const {
+    std::shared_lock guard(mutex_);
+    size_t result = 0;
+    for (const auto& segment : segments_) {
+        result += segment->GetMemoryUsage();
+    }
+    return result;
+}
+
+void SegmentedSearchServer::Flush() {
+    {
+        std::unique_lock guard(mutex_);
+        if (mutable_segment_.GetDocumentCount() == 0) {
+            return;
+        }
+        SealMutableSegment();
+    }
+    RequestMerge();
+}
+
+void SegmentedSearchServer::WaitForMerges() {
+    std::unique_lock guard(merge_mutex_);
+    merge_idle_cv_.wait(guard, [this] {
+        return !merge_requested_ && !merging_;
+        });
+}
+
+SegmentedSearchServer::Query SegmentedSearchServer::ParseQuery(std::string_view text) const {
+    Query result;
+    text_processor_.ForEachQueryWord(text, result.normalized_text, [&result](const TextProcessor::QueryWord& query_word) {
+        if (query_word.is_prefix) {
+            throw std::invalid_argument("Prefix words are not supported by the segmented index"s);
+        }
+        if (!query_word.is_stop) {
+            (query_word.is_minus ? result.minus_words : result.plus_words).push_back(query_word.data);
+        }
+        });
+    TextProcessor::RemoveDuplicateWords(result.plus_words);
+    TextProcessor::RemoveDuplicateWords(result.minus_words);
+    return result;
+}
+
+void SegmentedSearchServer::SealMutableSegment() {
+    segments_.push_back(ImmutableSegment::Seal(mutable_segment_, options_.term_freq_encoding));
+    mutable_segment_ = MutableSegment();
+}
+
+void SegmentedSearchServer::RequestMerge() {
+    {
+        std::lock_guard guard(merge_mutex_);
+        merge_requested_ = true;
+    }
+    merge_requested_cv_.notify_one();
+}
+
+void SegmentedSearchServer::MergeLoop() {
+    std::unique_lock guard(merge_mutex_);
+    while (true) {
+        merge_requested_cv_.wait(guard, [this] {
+            return stopping_ || merge_requested_;
+            });
+        if (stopping_) {
+            return;
+        }
+        merge_requested_ = false;
+        merging_ = true;
+        guard.unlock();
+        while (MergeOnce()) {
+        }
+        guard.lock();
+        merging_ = false;
+        merge_idle_cv_.notify_all();
+    }
+}
+
+std::vector<std::shared_ptr<ImmutableSegment>> SegmentedSearchServer::PickMergeCandidates() const {
+    std::map<size_t, std::vector<std::shared_ptr<ImmutableSegment>>> tiers;
+    for (const auto& segment : segments_) {
+        if (segment->GetLiveDocumentCount() == 0) {
+            // Nothing left to keep, a merge of this segment alone just drops it
+            return { segment };
+        }
+        size_t tier = 0;
+        for (size_t tier_limit = options_.max_mutable_documents * options_.merge_factor;
+            segment->GetLiveDocumentCount() >= tier_limit; tier_limit *= options_.merge_factor) {
+            ++tier;
+        }
+        auto& tier_segments = tiers[tier];
+        tier_segments.push_back(segment);
+        if (tier_segments.size() == options_.merge_factor) {
+            return tier_segments;
+        }
+    }
+    return {};
+}
+
+bool SegmentedSearchServer::MergeOnce() {
+    std::vector<std::shared_ptr<ImmutableSegment>> candidates;
+    std::vector<DocumentBitset> tombstones;
+    {
+        std::shared_lock guard(mutex_);
+        candidates = PickMergeCandidates();
+        for (const auto& segment : candidates) {
+            tombstones.push_back(segment->GetTombstones());
+        }
+    }
+    if (candidates.empty()) {
+        return false;
+    }
+
+    // The candidates are immutable apart from tombstones, so the merge itself
+    // runs concurrently with queries and ingestion
+    auto merged = ImmutableSegment::Merge(candidates, tombstones, options_.term_freq_encoding);
+
+    std::unique_lock guard(mutex_);
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        candidates[i]->GetTombstones().ForEach([&](size_t local_document) {
+            if (!tombstones[i].Test(local_document)) {
+                merged->RemoveDocument(candidates[i]->GetDocumentId(local_document));
+            }
+            });
+    }
+    segments_.erase(std::remove_if(segments_.begin(), segments_.end(), [&candidates](const auto& segment) {
+        return std::find(candidates.begin(), candidates.end(), segment) != candidates.end();
+        }), segments_.end());
+    if (merged->GetDocumentCount() > 0) {
+        segments_.push_back(std::move(merged));
+    }
+    return true;
+}
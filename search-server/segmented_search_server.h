@@ -0,0 +1,235 @@
+#pragma once
+#include "index_segment.h"
+#include "search_server.h"
+#include "text_processor.h"
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+#include <thread>
+
+struct SegmentedIndexOptions {
+    // The mutable segment is sealed once it holds this many documents
+    size_t max_mutable_documents = 1000;
+    // Segments of one size tier are merged when there are this many of them
+    size_t merge_factor = 4;
+    // Term frequency precision of the sealed segments
+    TermFreqEncoding term_freq_encoding = TermFreqEncoding::FLOAT32;
+    // Tokenization and normalization of documents, queries and stop words
+    TextAnalysis analysis;
+};
+
+// Log-structured variant of SearchServer. New documents go into a small
+// mutable segment, which is sealed into an immutable segment when full.
+// Immutable segments are merged by a background thread under a tiered policy,
+// deletions are tombstones until the next merge of their segment. Text is
+// split and queries are parsed by the same TextProcessor as in SearchServer;
+// prefix query words are not supported.
+class SegmentedSearchServer {
+public:
+    explicit SegmentedSearchServer(std::string_view stop_words_text, SegmentedIndexOptions options = {});
+    SegmentedSearchServer(const SegmentedSearchServer&) = delete;
+    SegmentedSearchServer& operator=(const SegmentedSearchServer&) = delete;
+    ~SegmentedSearchServer();
+
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status,
+        const std::vector<int>& ratings);
+    void RemoveDocument(int document_id);
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const;
+    // QueryMode::ALL keeps the documents containing every plus word
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, QueryMode mode,
+        DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
+
+    int GetDocumentCount() const;
+    size_t GetSegmentCount() const;
+    // Bytes held by the immutable segments
+    size_t GetSegmentMemoryUsage() const;
+
+    // Seals the mutable segment right away
+    void Flush();
+    // Blocks until the background thread has nothing left to merge
+    void WaitForMerges();
+
+private:
+    struct Query {
+        std::vector<std::string_view> plus_words;
+        std::vector<std::string_view> minus_words;
+        // Normalized copy of the query text when normalization changes it
+        std::unique_ptr<std::string> normalized_text;
+    };
+
+    const SegmentedIndexOptions options_;
+    const TextProcessor text_processor_;
+
+    mutable std::shared_mutex mutex_;
+    std::set<int> document_ids_;
+    MutableSegment mutable_segment_;
+    std::vector<std::shared_ptr<ImmutableSegment>> segments_;
+
+    std::mutex merge_mutex_;
+    std::condition_variable merge_requested_cv_;
+    std::condition_variable merge_idle_cv_;
+    bool merge_requested_ = false;
+    bool merging_ = false;
+    bool stopping_ = false;
+    std::thread merge_thread_;
+
+    Query ParseQuery(std::string_view text) const;
+
+    // Scores the documents of one segment a document at a time from cursors
+    // over its posting lists. Minus words are checked by skipping their
+    // cursors to the candidate, ALL queries leapfrog the plus word cursors,
+    // so blocks without a candidate are never decoded. The caller holds mutex_.
+    template <typename Segment, typename DocumentPredicate>
+    static void ScoreSegment(const Segment& segment, const Query& query, QueryMode mode,
+        const std::vector<double>& inverse_document_freqs, DocumentPredicate& document_predicate,
+        std::vector<Document>& matched_documents);
+
+    void SealMutableSegment();
+    void RequestMerge();
+    void MergeLoop();
+    bool MergeOnce();
+    std::vector<std::shared_ptr<ImmutableSegment>> PickMergeCandidates() const;
+};
+
+template <typename DocumentPredicate>
+std::vector<Document> SegmentedSearchServer::FindTopDocuments(std::string_view raw_query,
+    DocumentPredicate document_predicate) const {
+    return FindTopDocuments(raw_query, QueryMode::ANY, document_predicate);
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SegmentedSearchServer::FindTopDocuments(std::string_view raw_query, QueryMode mode,
+    DocumentPredicate document_predicate) const {
+    const auto query = ParseQuery(raw_query);
+
+    std::vector<Document> matched_documents;
+    {
+        std::shared_lock guard(mutex_);
+        const double document_count = document_ids_.size();
+        std::vector<double> inverse_document_freqs;
+        inverse_document_freqs.reserve(query.plus_words.size());
+        for (std::string_view word : query.plus_words) {
+            size_t document_freq = mutable_segment_.CountLivePostings(word);
+            for (const auto& segment : segments_) {
+                document_freq += segment->CountLivePostings(word);
+            }
+            inverse_document_freqs.push_back(document_freq == 0 ? 0.0 : log(document_count / document_freq));
+        }
+        // A document lives in one segment, so its relevance is complete there
+        ScoreSegment(mutable_segment_, query, mode, inverse_document_freqs, document_predicate, matched_documents);
+        for (const auto& segment : segments_) {
+            ScoreSegment(*segment, query, mode, inverse_document_freqs, document_predicate, matched_documents);
+        }
+    }
+
+    sort(matched_documents.begin(), matched_documents.end(), SearchServer::RanksBefore);
+    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
+        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+    }
+    return matched_documents;
+}
+
+template <typename Segment, typename DocumentPredicate>
+void SegmentedSearchServer::ScoreSegment(const Segment& segment, const Query& query, QueryMode mode,
+    const std::vector<double>& inverse_document_freqs, DocumentPredicate& document_predicate,
+    std::vector<Document>& matched_documents) {
+    using Cursor = typename Segment::Cursor;
+    if (query.plus_words.empty()) {
+        return;
+    }
+    std::vector<size_t> order(query.plus_words.size());
+    std::iota(order.begin(), order.end(), 0);
+    if (mode == QueryMode::ALL) {
+        // The shortest list drives the intersection
+        std::vector<size_t> posting_counts;
+        for (std::string_view word : query.plus_words) {
+            posting_counts.push_back(segment.GetPostingCount(word));
+        }
+        std::sort(order.begin(), order.end(), [&posting_counts](size_t lhs, size_t rhs) {
+            return posting_counts[lhs] < posting_counts[rhs];
+        });
+    }
+    std::vector<Cursor> plus_cursors;
+    std::vector<double> weights;
+    plus_cursors.reserve(order.size());
+    for (const size_t i : order) {
+        plus_cursors.push_back(segment.GetCursor(query.plus_words[i]));
+        weights.push_back(inverse_document_freqs[i]);
+    }
+    std::vector<Cursor> minus_cursors;
+    minus_cursors.reserve(query.minus_words.size());
+    for (std::string_view word : query.minus_words) {
+        minus_cursors.push_back(segment.GetCursor(word));
+    }
+
+    const auto accept = [&](uint32_t document, double relevance) {
+        if (!segment.IsLive(document)) {
+            return;
+        }
+        for (Cursor& cursor : minus_cursors) {
+            cursor.SkipTo(document);
+            if (!cursor.AtEnd() && cursor.GetDocument() == document) {
+                return;
+            }
+        }
+        const SegmentDocument& data = segment.GetDocument(document);
+        if (document_predicate(data.id, data.status, data.rating)) {
+            matched_documents.push_back({ data.id, relevance, data.rating });
+        }
+    };
+
+    if (mode == QueryMode::ALL) {
+        Cursor& driver = plus_cursors.front();
+        while (!driver.AtEnd()) {
+            const uint32_t document = driver.GetDocument();
+            uint32_t next_document = document;
+            for (size_t i = 1; i < plus_cursors.size() && next_document == document; ++i) {
+                plus_cursors[i].SkipTo(document);
+                next_document = plus_cursors[i].AtEnd() ? UINT32_MAX : plus_cursors[i].GetDocument();
+            }
+            if (next_document != document) {
+                if (next_document == UINT32_MAX) {
+                    return;
+                }
+                driver.SkipTo(next_document);
+                continue;
+            }
+            double relevance = 0;
+            for (size_t i = 0; i < plus_cursors.size(); ++i) {
+                relevance += plus_cursors[i].GetTermFreq() * weights[i];
+            }
+            accept(document, relevance);
+            driver.Next();
+        }
+        return;
+    }
+
+    while (true) {
+        uint32_t document = UINT32_MAX;
+        bool found = false;
+        for (const Cursor& cursor : plus_cursors) {
+            if (!cursor.AtEnd() && (!found || cursor.GetDocument() < document)) {
+                document = cursor.GetDocument();
+                found = true;
+            }
+        }
+        if (!found) {
+            return;
+        }
+        double relevance = 0;
+        for (size_t i = 0; i < plus_cursors.size(); ++i) {
+            if (!plus_cursors[i].AtEnd() && plus_cursors[i].GetDocument() == document) {
+                relevance += plus_cursors[i].GetTermFreq() * weights[i];
+                plus_cursors[i].Next();
+            }
+        }
+        accept(document, relevance);
+    }
+}
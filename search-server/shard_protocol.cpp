@@ -0,0 +1,331 @@
+#include "shard_protocol.h"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+using namespace std::string_literals;
+
+namespace {
+
+const uint32_t MAX_FRAME_SIZE = 256u << 20;
+
+void WriteStatistics(BinaryWriter& writer, const TermStatistics& statistics) {
+    writer.WriteU32(statistics.document_count);
+    writer.WriteU32(statistics.document_freqs.size());
+    for (const auto& [word, document_freq] : statistics.document_freqs) {
+        writer.WriteString(word);
+        writer.WriteU32(document_freq);
+    }
+}
+
+// Smallest encodings of the repeated elements: an empty string is its size
+constexpr size_t MIN_STRING_SIZE = 4;
+constexpr size_t MIN_REQUEST_SIZE = 1 + MIN_STRING_SIZE;
+constexpr size_t MIN_RESPONSE_SIZE = 1;
+constexpr size_t DOCUMENT_SIZE = 4 + 8 + 4;
+constexpr size_t MIN_STATISTICS_ENTRY_SIZE = MIN_STRING_SIZE + 4;
+
+TermStatistics ReadStatistics(BinaryReader& reader) {
+    TermStatistics statistics;
+    statistics.document_count = reader.ReadU32();
+    for (uint32_t count = reader.ReadCount(MIN_STATISTICS_ENTRY_SIZE); count > 0; --count) {
+        std::string word = reader.ReadString();
+        statistics.document_freqs[std::move(word)] = reader.ReadU32();
+    }
+    return statistics;
+}
+
+DocumentStatus ReadStatus(BinaryReader& reader) {
+    const uint8_t status = reader.ReadU8();
+    if (status > static_cast<uint8_t>(DocumentStatus::REMOVED)) {
+        throw std::invalid_argument("Unknown document status"s);
+    }
+    return static_cast<DocumentStatus>(status);
+}
+
+} // namespace
+
+void BinaryWriter::WriteU8(uint8_t value) {
+    buffer_.push_back(static_cast<char>(value));
+}
+
+void BinaryWriter::WriteU32(uint32_t value) {
+    for (int shift = 0; shift < 32; shift += 8) {
+        buffer_.push_back(static_cast<char>((value >> shift) & 0xFF));
+    }
+}
+
+void BinaryWriter::WriteI32(int32_t value) {
+    WriteU32(static_cast<uint32_t>(value));
+}
+
+void BinaryWriter::WriteDouble(double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    WriteU32(static_cast<uint32_t>(bits));
+    WriteU32(static_cast<uint32_t>(bits >> 32));
+}
+
+void BinaryWriter::WriteString(std::string_view value) {
+    WriteU32(value.size());
+    buffer_.append(value);
+}
+
+std::string& BinaryWriter::GetBuffer() {
+    return buffer_;
+}
+
+BinaryReader::BinaryReader(std::string_view buffer)
+    : buffer_(buffer) {
+}
+
+std::string_view BinaryReader::Take(size_t size) {
+    if (buffer_.size() < size) {
+        throw std::out_of_range("Truncated shard message"s);
+    }
+    const auto result = buffer_.substr(0, size);
+    buffer_.remove_prefix(size);
+    return result;
+}
+
+uint8_t BinaryReader::ReadU8() {
+    return static_cast<uint8_t>(Take(1)[0]);
+}
+
+uint32_t BinaryReader::ReadU32() {
+    const auto bytes = Take(4);
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; --i) {
+        value = (value << 8) | static_cast<uint8_t>(bytes[i]);
+    }
+    return value;
+}
+
+int32_t BinaryReader::ReadI32() {
+    return static_cast<int32_t>(ReadU32());
+}
+
+double BinaryReader::ReadDouble() {
+    const uint64_t low = ReadU32();
+    const uint64_t high = ReadU32();
+    const uint64_t bits = low | (high << 32);
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+std::string BinaryReader::ReadString() {
+    const uint32_t size = ReadU32();
+    return std::string(Take(size));
+}
+
+uint32_t BinaryReader::ReadCount(size_t min_encoded_size) {
+    const uint32_t count = ReadU32();
+    if (count > Remaining() / min_encoded_size) {
+        throw std::out_of_range("Truncated shard message"s);
+    }
+    return count;
+}
+
+size_t BinaryReader::Remaining() const {
+    return buffer_.size();
+}
+
+bool BinaryReader::AtEnd() const {
+    return buffer_.empty();
+}
+
+std::string EncodeRequests(const std::vector<ShardRequest>& requests) {
+    BinaryWriter writer;
+    writer.WriteU32(requests.size());
+    for (const ShardRequest& request : requests) {
+        writer.WriteU8(static_cast<uint8_t>(request.type));
+        writer.WriteString(request.raw_query);
+        switch (request.type) {
+        case ShardRequestType::TERM_STATISTICS:
+            break;
+        case ShardRequestType::FIND_TOP_DOCUMENTS:
+            writer.WriteU8(static_cast<uint8_t>(request.status));
+            WriteStatistics(writer, request.global_statistics);
+            break;
+        case ShardRequestType::MATCH_DOCUMENT:
+            writer.WriteI32(request.document_id);
+            break;
+        }
+    }
+    return std::move(writer.GetBuffer());
+}
+
+std::vector<ShardRequest> DecodeRequests(std::string_view payload) {
+    BinaryReader reader(payload);
+    std::vector<ShardRequest> requests(reader.ReadCount(MIN_REQUEST_SIZE));
+    for (ShardRequest& request : requests) {
+        const uint8_t type = reader.ReadU8();
+        if (type > static_cast<uint8_t>(ShardRequestType::MATCH_DOCUMENT)) {
+            throw std::invalid_argument("Unknown shard request type"s);
+        }
+        request.type = static_cast<ShardRequestType>(type);
+        request.raw_query = reader.ReadString();
+        switch (request.type) {
+        case ShardRequestType::TERM_STATISTICS:
+            break;
+        case ShardRequestType::FIND_TOP_DOCUMENTS:
+            request.status = ReadStatus(reader);
+            request.global_statistics = ReadStatistics(reader);
+            break;
+        case ShardRequestType::MATCH_DOCUMENT:
+            request.document_id = reader.ReadI32();
+            break;
+        }
+    }
+    return requests;
+}
+
+std::string EncodeResponses(const std::vector<ShardRequest>& requests, const std::vector<ShardResponse>& responses) {
+    BinaryWriter writer;
+    writer.WriteU32(responses.size());
+    for (size_t i = 0; i < responses.size(); ++i) {
+        const ShardResponse& response = responses[i];
+        writer.WriteU8(response.ok);
+        if (!response.ok) {
+            writer.WriteString(response.error);
+            continue;
+        }
+        switch (requests[i].type) {
+        case ShardRequestType::TERM_STATISTICS:
+            WriteStatistics(writer, response.statistics);
+            break;
+        case ShardRequestType::FIND_TOP_DOCUMENTS:
+            writer.WriteU32(response.documents.size());
+            for (const Document& document : response.documents) {
+                writer.WriteI32(document.id);
+                writer.WriteDouble(document.relevance);
+                writer.WriteI32(document.rating);
+            }
+            break;
+        case ShardRequestType::MATCH_DOCUMENT:
+            writer.WriteU8(response.document_found);
+            writer.WriteU8(static_cast<uint8_t>(response.status));
+            writer.WriteU32(response.matched_words.size());
+            for (const std::string& word : response.matched_words) {
+                writer.WriteString(word);
+            }
+            break;
+        }
+    }
+    return std::move(writer.GetBuffer());
+}
+
+std::vector<ShardResponse> DecodeResponses(const std::vector<ShardRequest>& requests, std::string_view payload) {
+    BinaryReader reader(payload);
+    std::vector<ShardResponse> responses(reader.ReadCount(MIN_RESPONSE_SIZE));
+    if (responses.size() != requests.size()) {
+        throw std::invalid_argument("Shard response count mismatch"s);
+    }
+    for (size_t i = 0; i < responses.size(); ++i) {
+        ShardResponse& response = responses[i];
+        response.ok = reader.ReadU8() != 0;
+        if (!response.ok) {
+            response.error = reader.ReadString();
+            continue;
+        }
+        switch (requests[i].type) {
+        case ShardRequestType::TERM_STATISTICS:
+            response.statistics = ReadStatistics(reader);
+            break;
+        case ShardRequestType::FIND_TOP_DOCUMENTS:
+            response.documents.resize(reader.ReadCount(DOCUMENT_SIZE));
+            for (Document& document : response.documents) {
+                document.id = reader.ReadI32();
+                document.relevance = reader.ReadDouble();
+                document.rating = reader.ReadI32();
+            }
+            break;
+        case ShardRequestType::MATCH_DOCUMENT:
+            response.document_found = reader.ReadU8() != 0;
+            response.status = ReadStatus(reader);
+            response.matched_words.resize(reader.ReadCount(MIN_STRING_SIZE));
+            for (std::string& word : response.matched_words) {
+                word = reader.ReadString();
+            }
+            break;
+        }
+    }
+    return responses;
+}
+
+#ifndef _WIN32
+
+bool WriteFrame(int fd, std::string_view payload) {
+    BinaryWriter header;
+    header.WriteU32(payload.size());
+    // One syscall per frame when possible: header and payload go out together
+    std::string frame = std::move(header.GetBuffer());
+    frame.append(payload);
+    size_t written = 0;
+    while (written < frame.size()) {
+        const ssize_t result = send(fd, frame.data() + written, frame.size() - written, MSG_NOSIGNAL);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EPIPE || errno == ECONNRESET) {
+                return false;
+            }
+            throw std::system_error(errno, std::generic_category(), "send"s);
+        }
+        written += result;
+    }
+    return true;
+}
+
+namespace {
+
+bool ReadExactly(int fd, char* data, size_t size) {
+    size_t received = 0;
+    while (received < size) {
+        const ssize_t result = recv(fd, data + received, size - received, 0);
+        if (result == 0) {
+            if (received == 0) {
+                return false;
+            }
+            throw std::out_of_range("Connection closed in the middle of a frame"s);
+        }
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == ECONNRESET && received == 0) {
+                return false;
+            }
+            throw std::system_error(errno, std::generic_category(), "recv"s);
+        }
+        received += result;
+    }
+    return true;
+}
+
+} // namespace
+
+bool ReadFrame(int fd, std::string& payload) {
+    char header[4];
+    if (!ReadExactly(fd, header, sizeof(header))) {
+        return false;
+    }
+    const uint32_t size = BinaryReader(std::string_view(header, sizeof(header))).ReadU32();
+    if (size > MAX_FRAME_SIZE) {
+        throw std::out_of_range("Shard frame is too large"s);
+    }
+    payload.resize(size);
+    if (size > 0 && !ReadExactly(fd, payload.data(), size)) {
+        throw std::out_of_range("Connection closed in the middle of a frame"s);
+    }
+    return true;
+}
+
+#endif // _WIN32
@@ -0,0 +1,84 @@
+#pragma once
+#include "search_server.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Binary protocol between ShardRouter and ShardServer over a Unix domain socket.
+// Every frame is a little-endian u32 payload length followed by the payload.
+// A request frame carries a batch of requests, the reply frame carries one
+// response per request in the same order.
+enum class ShardRequestType : uint8_t {
+    TERM_STATISTICS,
+    FIND_TOP_DOCUMENTS,
+    MATCH_DOCUMENT,
+};
+
+struct ShardRequest {
+    ShardRequestType type = ShardRequestType::FIND_TOP_DOCUMENTS;
+    std::string raw_query;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    int document_id = 0;
+    TermStatistics global_statistics;
+};
+
+struct ShardResponse {
+    bool ok = true;
+    std::string error;
+    TermStatistics statistics;
+    std::vector<Document> documents;
+    bool document_found = false;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<std::string> matched_words;
+};
+
+class BinaryWriter {
+public:
+    void WriteU8(uint8_t value);
+    void WriteU32(uint32_t value);
+    void WriteI32(int32_t value);
+    void WriteDouble(double value);
+    void WriteString(std::string_view value);
+
+    std::string& GetBuffer();
+
+private:
+    std::string buffer_;
+};
+
+class BinaryReader {
+public:
+    explicit BinaryReader(std::string_view buffer);
+
+    uint8_t ReadU8();
+    uint32_t ReadU32();
+    int32_t ReadI32();
+    double ReadDouble();
+    std::string ReadString();
+    // Reads an element count and checks that the rest of the message can hold
+    // that many elements of at least min_encoded_size bytes, so that a corrupt
+    // count cannot make the decoder allocate before it runs out of input
+    uint32_t ReadCount(size_t min_encoded_size);
+
+    size_t Remaining() const;
+    bool AtEnd() const;
+
+private:
+    std::string_view buffer_;
+
+    std::string_view Take(size_t size);
+};
+
+std::string EncodeRequests(const std::vector<ShardRequest>& requests);
+std::vector<ShardRequest> DecodeRequests(std::string_view payload);
+
+std::string EncodeResponses(const std::vector<ShardRequest>& requests, const std::vector<ShardResponse>& responses);
+std::vector<ShardResponse> DecodeResponses(const std::vector<ShardRequest>& requests, std::string_view payload);
+
+#ifndef _WIN32
+// Blocking frame I/O over a socket, false on orderly shutdown of the peer.
+// Sharding uses Unix domain sockets and is not built on Windows.
+bool WriteFrame(int fd, std::string_view payload);
+bool ReadFrame(int fd, std::string& payload);
+#endif
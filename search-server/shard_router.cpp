@@ -0,0 +1,140 @@
+#include "shard_router.h"
+#include <cerrno>
+#include <cstring>
+#include <future>
+#include <stdexcept>
+#include <system_error>
+
+#ifndef _WIN32
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std::string_literals;
+
+ShardRouter::Connection::Connection(const std::string& socket_path) {
+    sockaddr_un address{};
+    if (socket_path.empty() || socket_path.size() >= sizeof(address.sun_path)) {
+        throw std::invalid_argument("Invalid shard socket path "s + socket_path);
+    }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, socket_path.data(), socket_path.size());
+
+    fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd_ < 0) {
+        throw std::system_error(errno, std::generic_category(), "socket"s);
+    }
+    if (connect(fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+        const int error = errno;
+        close(fd_);
+        throw std::system_error(error, std::generic_category(), "connect "s + socket_path);
+    }
+}
+
+ShardRouter::Connection::~Connection() {
+    close(fd_);
+}
+
+std::vector<ShardResponse> ShardRouter::Connection::Execute(const std::vector<ShardRequest>& requests) {
+    std::lock_guard guard(mutex_);
+    if (!WriteFrame(fd_, EncodeRequests(requests)) || !ReadFrame(fd_, buffer_)) {
+        throw std::runtime_error("Shard closed the connection"s);
+    }
+    return DecodeResponses(requests, buffer_);
+}
+
+ShardRouter::ShardRouter(const std::vector<std::string>& socket_paths) {
+    if (socket_paths.empty()) {
+        throw std::invalid_argument("Router needs at least one shard"s);
+    }
+    for (const std::string& path : socket_paths) {
+        shards_.push_back(std::make_unique<Connection>(path));
+    }
+}
+
+size_t ShardRouter::GetShardCount() const {
+    return shards_.size();
+}
+
+std::vector<std::vector<ShardResponse>> ShardRouter::Broadcast(const std::vector<ShardRequest>& requests) const {
+    std::vector<std::future<std::vector<ShardResponse>>> futures;
+    futures.reserve(shards_.size());
+    for (const auto& shard : shards_) {
+        futures.push_back(std::async(std::launch::async, [&shard, &requests] {
+            return shard->Execute(requests);
+        }));
+    }
+    std::vector<std::vector<ShardResponse>> result;
+    result.reserve(futures.size());
+    for (auto& future : futures) {
+        result.push_back(future.get());
+        for (const ShardResponse& response : result.back()) {
+            if (!response.ok) {
+                throw std::invalid_argument(response.error);
+            }
+        }
+    }
+    return result;
+}
+
+std::vector<Document> ShardRouter::FindTopDocuments(std::string_view raw_query, DocumentStatus status) const {
+    return FindTopDocuments(std::vector<std::string>{ std::string(raw_query) }, status).front();
+}
+
+std::vector<std::vector<Document>> ShardRouter::FindTopDocuments(const std::vector<std::string>& raw_queries,
+    DocumentStatus status) const {
+    std::vector<ShardRequest> requests(raw_queries.size());
+    for (size_t i = 0; i < raw_queries.size(); ++i) {
+        requests[i].type = ShardRequestType::TERM_STATISTICS;
+        requests[i].raw_query = raw_queries[i];
+    }
+
+    // Global document frequencies: the shards hold disjoint document sets
+    for (const auto& shard_responses : Broadcast(requests)) {
+        for (size_t i = 0; i < requests.size(); ++i) {
+            const TermStatistics& shard_statistics = shard_responses[i].statistics;
+            TermStatistics& global_statistics = requests[i].global_statistics;
+            global_statistics.document_count += shard_statistics.document_count;
+            for (const auto& [word, document_freq] : shard_statistics.document_freqs) {
+                global_statistics.document_freqs[word] += document_freq;
+            }
+        }
+    }
+
+    for (ShardRequest& request : requests) {
+        request.type = ShardRequestType::FIND_TOP_DOCUMENTS;
+        request.status = status;
+    }
+
+    std::vector<std::vector<Document>> result(requests.size());
+    for (const auto& shard_responses : Broadcast(requests)) {
+        for (size_t i = 0; i < requests.size(); ++i) {
+            result[i].insert(result[i].end(), shard_responses[i].documents.begin(), shard_responses[i].documents.end());
+        }
+    }
+    for (auto& documents : result) {
+        sort(documents.begin(), documents.end(), SearchServer::RanksBefore);
+        if (documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
+            documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+        }
+    }
+    return result;
+}
+
+MatchedWordsStatus ShardRouter::MatchDocument(std::string_view raw_query, int document_id) const {
+    std::vector<ShardRequest> requests(1);
+    requests[0].type = ShardRequestType::MATCH_DOCUMENT;
+    requests[0].raw_query = std::string(raw_query);
+    requests[0].document_id = document_id;
+
+    for (auto& shard_responses : Broadcast(requests)) {
+        ShardResponse& response = shard_responses.front();
+        if (response.document_found) {
+            return { std::move(response.matched_words), response.status };
+        }
+    }
+    throw std::out_of_range("Document "s + std::to_string(document_id) + " is not found on any shard"s);
+}
+
+#endif // _WIN32
@@ -0,0 +1,53 @@
+#pragma once
+#include "search_server.h"
+#include "shard_protocol.h"
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#ifndef _WIN32
+
+using MatchedWordsStatus = std::tuple<std::vector<std::string>, DocumentStatus>;
+
+// Fans queries out to ShardServer processes and merges their answers. Scoring
+// is done in two round trips per batch: the shards first report document
+// frequencies, then score with the merged global IDF, so the merged top
+// documents are the same as for a single server holding the whole corpus.
+class ShardRouter {
+public:
+    explicit ShardRouter(const std::vector<std::string>& socket_paths);
+
+    std::vector<Document> FindTopDocuments(std::string_view raw_query,
+        DocumentStatus status = DocumentStatus::ACTUAL) const;
+    // All queries of a batch travel to a shard in one frame per round trip
+    std::vector<std::vector<Document>> FindTopDocuments(const std::vector<std::string>& raw_queries,
+        DocumentStatus status = DocumentStatus::ACTUAL) const;
+
+    MatchedWordsStatus MatchDocument(std::string_view raw_query, int document_id) const;
+
+    size_t GetShardCount() const;
+
+private:
+    class Connection {
+    public:
+        explicit Connection(const std::string& socket_path);
+        Connection(const Connection&) = delete;
+        Connection& operator=(const Connection&) = delete;
+        ~Connection();
+
+        std::vector<ShardResponse> Execute(const std::vector<ShardRequest>& requests);
+
+    private:
+        int fd_ = -1;
+        std::mutex mutex_;
+        std::string buffer_;
+    };
+
+    std::vector<std::unique_ptr<Connection>> shards_;
+
+    std::vector<std::vector<ShardResponse>> Broadcast(const std::vector<ShardRequest>& requests) const;
+};
+
+#endif // _WIN32
@@ -0,0 +1,147 @@
+#include "shard_server.h"
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+#ifndef _WIN32
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace std::string_literals;
+
+ShardServer::ShardServer(const SearchServer& search_server, std::string socket_path)
+    : search_server_(search_server)
+    , socket_path_(std::move(socket_path)) {
+    sockaddr_un address{};
+    if (socket_path_.empty() || socket_path_.size() >= sizeof(address.sun_path)) {
+        throw std::invalid_argument("Invalid shard socket path "s + socket_path_);
+    }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, socket_path_.data(), socket_path_.size());
+
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) {
+        throw std::system_error(errno, std::generic_category(), "socket"s);
+    }
+    unlink(socket_path_.c_str());
+    if (bind(listen_fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0
+        || listen(listen_fd_, SOMAXCONN) < 0) {
+        const int error = errno;
+        close(listen_fd_);
+        throw std::system_error(error, std::generic_category(), "bind "s + socket_path_);
+    }
+}
+
+ShardServer::~ShardServer() {
+    Stop();
+    {
+        std::unique_lock lock(clients_mutex_);
+        clients_done_.wait(lock, [this] {
+            return client_fds_.empty();
+        });
+    }
+    close(listen_fd_);
+    unlink(socket_path_.c_str());
+}
+
+const std::string& ShardServer::GetSocketPath() const {
+    return socket_path_;
+}
+
+void ShardServer::Run() {
+    while (!stopping_) {
+        const int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (stopping_) {
+                break;
+            }
+            throw std::system_error(errno, std::generic_category(), "accept"s);
+        }
+        std::lock_guard guard(clients_mutex_);
+        if (stopping_) {
+            close(fd);
+            break;
+        }
+        client_fds_.insert(fd);
+        std::thread([this, fd] {
+            ServeConnection(fd);
+        }).detach();
+    }
+}
+
+void ShardServer::Stop() {
+    if (stopping_.exchange(true)) {
+        return;
+    }
+    // Wakes up the accept() in Run() and every recv() in the connection threads
+    shutdown(listen_fd_, SHUT_RDWR);
+    std::lock_guard guard(clients_mutex_);
+    for (const int fd : client_fds_) {
+        shutdown(fd, SHUT_RDWR);
+    }
+}
+
+void ShardServer::ServeConnection(int fd) {
+    try {
+        std::string payload;
+        while (ReadFrame(fd, payload)) {
+            const auto requests = DecodeRequests(payload);
+            std::vector<ShardResponse> responses;
+            responses.reserve(requests.size());
+            for (const ShardRequest& request : requests) {
+                responses.push_back(HandleRequest(request));
+            }
+            if (!WriteFrame(fd, EncodeResponses(requests, responses))) {
+                break;
+            }
+        }
+    }
+    catch (const std::exception&) {
+        // A malformed or broken connection only affects its own client
+    }
+    std::lock_guard guard(clients_mutex_);
+    client_fds_.erase(fd);
+    close(fd);
+    // Under the lock: the destructor may run as soon as it is released
+    clients_done_.notify_all();
+}
+
+ShardResponse ShardServer::HandleRequest(const ShardRequest& request) const {
+    ShardResponse response;
+    try {
+        switch (request.type) {
+        case ShardRequestType::TERM_STATISTICS:
+            response.statistics = search_server_.GetTermStatistics(request.raw_query);
+            break;
+        case ShardRequestType::FIND_TOP_DOCUMENTS:
+            response.documents = search_server_.FindTopDocuments(request.raw_query, request.status,
+                request.global_statistics);
+            break;
+        case ShardRequestType::MATCH_DOCUMENT:
+            try {
+                const auto [words, status] = search_server_.MatchDocument(request.raw_query, request.document_id);
+                response.document_found = true;
+                response.status = status;
+                response.matched_words.assign(words.begin(), words.end());
+            }
+            catch (const std::out_of_range&) {
+                // The document lives on another shard
+                response.document_found = false;
+            }
+            break;
+        }
+    }
+    catch (const std::exception& e) {
+        response.ok = false;
+        response.error = e.what();
+    }
+    return response;
+}
+
+#endif // _WIN32
@@ -0,0 +1,41 @@
+#pragma once
+#include "search_server.h"
+#include "shard_protocol.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <string>
+
+#ifndef _WIN32
+
+// Serves one shard of the index over a Unix domain socket. Run() blocks in the
+// accept loop, so a shard process is just a SearchServer plus ShardServer::Run().
+// Every connection is served by a detached thread; the destructor waits for
+// the live ones to finish.
+class ShardServer {
+public:
+    ShardServer(const SearchServer& search_server, std::string socket_path);
+    ShardServer(const ShardServer&) = delete;
+    ShardServer& operator=(const ShardServer&) = delete;
+    ~ShardServer();
+
+    void Run();
+    void Stop();
+
+    const std::string& GetSocketPath() const;
+
+private:
+    const SearchServer& search_server_;
+    const std::string socket_path_;
+    int listen_fd_ = -1;
+    std::atomic<bool> stopping_ = false;
+    std::mutex clients_mutex_;
+    std::condition_variable clients_done_;
+    std::set<int> client_fds_;
+
+    void ServeConnection(int fd);
+    ShardResponse HandleRequest(const ShardRequest& request) const;
+};
+
+#endif // _WIN32
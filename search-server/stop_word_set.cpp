@@ -0,0 +1,95 @@
+#include "stop_word_set.h"
+#include "memory_stats.h"
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std::string_literals;
+
+StopWordSet::StopWordSet(const std::set<std::string, std::less<>>& words)
+    : size_(words.size()) {
+    for (const std::string& word : words) {
+        if (word.empty()) {
+            throw std::invalid_argument("Stop word is empty"s);
+        }
+        if (word.size() < MAX_PREFILTER_LENGTH) {
+            lengths_ |= uint64_t{ 1 } << word.size();
+        }
+        else {
+            has_long_words_ = true;
+        }
+        const unsigned char first = static_cast<unsigned char>(word[0]);
+        first_bytes_[first >> 6] |= uint64_t{ 1 } << (first & 63);
+    }
+    if (words.empty()) {
+        return;
+    }
+    // A minimal table almost always works; grow it in the rare case some
+    // bucket finds no free placement
+    for (size_t table_size = words.size(); !TryBuild(words, table_size); ++table_size) {
+    }
+}
+
+bool StopWordSet::TryBuild(const std::set<std::string, std::less<>>& words, size_t table_size) {
+    constexpr uint32_t MAX_DISPLACEMENT = 1 << 16;
+
+    std::vector<std::vector<std::pair<uint64_t, const std::string*>>> buckets(words.size() / 2 + 1);
+    for (const std::string& word : words) {
+        const uint64_t hash = Hash(word);
+        buckets[hash % buckets.size()].emplace_back(hash, &word);
+    }
+    // Place the largest buckets first while the table is still empty
+    std::vector<size_t> order(buckets.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&buckets](size_t lhs, size_t rhs) {
+        return buckets[lhs].size() > buckets[rhs].size();
+        });
+
+    slots_.assign(table_size, std::string());
+    displacements_.assign(buckets.size(), 0);
+    std::vector<bool> occupied(table_size);
+    std::vector<size_t> bucket_slots;
+    for (const size_t bucket : order) {
+        if (buckets[bucket].empty()) {
+            break;
+        }
+        bool placed = false;
+        for (uint32_t displacement = 0; displacement < MAX_DISPLACEMENT && !placed; ++displacement) {
+            bucket_slots.clear();
+            placed = true;
+            for (const auto& [hash, word] : buckets[bucket]) {
+                const size_t slot = GetSlot(hash, displacement, table_size);
+                if (occupied[slot] || std::find(bucket_slots.begin(), bucket_slots.end(), slot) != bucket_slots.end()) {
+                    placed = false;
+                    break;
+                }
+                bucket_slots.push_back(slot);
+            }
+            if (placed) {
+                displacements_[bucket] = displacement;
+                for (size_t i = 0; i < bucket_slots.size(); ++i) {
+                    occupied[bucket_slots[i]] = true;
+                    slots_[bucket_slots[i]] = *buckets[bucket][i].second;
+                }
+            }
+        }
+        if (!placed) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t StopWordSet::size() const {
+    return size_;
+}
+
+size_t StopWordSet::GetMemoryUsage() const {
+    size_t result = EstimateAllocation(slots_.capacity() * sizeof(std::string))
+        + EstimateAllocation(displacements_.capacity() * sizeof(uint32_t));
+    for (const std::string& word : slots_) {
+        result += EstimateStringHeap(word);
+    }
+    return result;
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Immutable set of stop words behind a perfect hash built with hash and
+// displace: a word hashes to a bucket, the bucket's displacement sends it to
+// its own slot, so a lookup is one hash and at most one string compare.
+// Most words are rejected before hashing by their length and first byte.
+class StopWordSet {
+public:
+    StopWordSet() = default;
+    explicit StopWordSet(const std::set<std::string, std::less<>>& words);
+
+    bool Contains(std::string_view word) const;
+    size_t size() const;
+
+    template <typename Function>
+    void ForEach(Function function) const;
+
+    size_t GetMemoryUsage() const;
+
+private:
+    static constexpr size_t MAX_PREFILTER_LENGTH = 64;
+
+    static uint64_t Hash(std::string_view word);
+    static size_t GetSlot(uint64_t hash, uint32_t displacement, size_t table_size);
+    bool TryBuild(const std::set<std::string, std::less<>>& words, size_t table_size);
+
+    std::vector<std::string> slots_;
+    std::vector<uint32_t> displacements_;
+    // Bit i is set when some stop word is i bytes long
+    uint64_t lengths_ = 0;
+    bool has_long_words_ = false;
+    uint64_t first_bytes_[4] = {};
+    size_t size_ = 0;
+};
+
+inline uint64_t StopWordSet::Hash(std::string_view word) {
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const char c : word) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+inline size_t StopWordSet::GetSlot(uint64_t hash, uint32_t displacement, size_t table_size) {
+    uint64_t mixed = hash ^ (displacement * 0x9E3779B97F4A7C15ULL);
+    mixed = (mixed ^ (mixed >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    mixed = (mixed ^ (mixed >> 27)) * 0x94D049BB133111EBULL;
+    return static_cast<size_t>((mixed ^ (mixed >> 31)) % table_size);
+}
+
+inline bool StopWordSet::Contains(std::string_view word) const {
+    if (word.size() < MAX_PREFILTER_LENGTH ? (lengths_ >> word.size() & 1) == 0 : !has_long_words_) {
+        return false;
+    }
+    const unsigned char first = static_cast<unsigned char>(word[0]);
+    if ((first_bytes_[first >> 6] >> (first & 63) & 1) == 0) {
+        return false;
+    }
+    const uint64_t hash = Hash(word);
+    const uint32_t displacement = displacements_[hash % displacements_.size()];
+    return slots_[GetSlot(hash, displacement, slots_.size())] == word;
+}
+
+template <typename Function>
+void StopWordSet::ForEach(Function function) const {
+    for (const std::string& word : slots_) {
+        if (!word.empty()) {
+            function(word);
+        }
+    }
+}
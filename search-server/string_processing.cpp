@@ -1,4 +1,5 @@
 #include "string_processing.h"
+#include <algorithm>
 
 using namespace std::string_literals;
 
@@ -15,4 +16,10 @@ std::vector<std::string_view> SplitIntoWords(std::string_view str) {
         }
     }
     return result;
+}
+
+bool IsValidWord(std::string_view word) {
+    return std::none_of(word.begin(), word.end(), [](char c) {
+        return c >= '\0' && c < ' ';
+        });
 }
\ No newline at end of file
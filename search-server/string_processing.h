@@ -6,6 +6,9 @@
 
 std::vector<std::string_view> SplitIntoWords(std::string_view text);
 
+// A valid word must not contain special characters
+bool IsValidWord(std::string_view word);
+
 template <typename StringContainer>
 std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
     std::set<std::string, std::less<>> non_empty_strings;
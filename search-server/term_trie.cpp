@@ -0,0 +1,314 @@
+#include "term_trie.h"
+#include "memory_stats.h"
+#include <algorithm>
+
+namespace {
+
+// Labels are ordered by bytes as unsigned values, as std::string compares them
+bool IsByteBefore(char lhs, char rhs) {
+    return static_cast<unsigned char>(lhs) < static_cast<unsigned char>(rhs);
+}
+
+// Code points of UTF-8 text, counted as FindWithinDistance decodes them
+uint16_t CountCodePoints(std::string_view text);
+
+}
+
+TermTrie::TermTrie()
+    : nodes_(1) {
+}
+
+void TermTrie::Insert(std::string_view term) {
+    const uint16_t length = CountCodePoints(term);
+    uint32_t node = 0;
+    size_t position = 0;
+    while (position < term.size()) {
+        AddLength(nodes_[node], length);
+        uint32_t previous = NO_NODE;
+        uint32_t child = nodes_[node].first_child;
+        // Siblings are kept sorted by the first character of their labels
+        while (child != NO_NODE && IsByteBefore(GetLabel(nodes_[child])[0], term[position])) {
+            previous = child;
+            child = nodes_[child].next_sibling;
+        }
+        if (child == NO_NODE || GetLabel(nodes_[child])[0] != term[position]) {
+            terms_.push_back(term);
+            const uint32_t leaf = AddNode(static_cast<uint32_t>(terms_.size() - 1), position, term.size());
+            nodes_[leaf].term = static_cast<uint32_t>(terms_.size() - 1);
+            AddLength(nodes_[leaf], length);
+            nodes_[leaf].next_sibling = child;
+            (previous == NO_NODE ? nodes_[node].first_child : nodes_[previous].next_sibling) = leaf;
+            break;
+        }
+
+        const std::string_view label = GetLabel(nodes_[child]);
+        const std::string_view rest = term.substr(position);
+        const size_t common = std::mismatch(label.begin(), label.begin() + std::min(label.size(), rest.size()),
+            rest.begin()).first - label.begin();
+        if (common < label.size()) {
+            // Split the edge at the first differing character
+            const uint32_t middle = AddNode(nodes_[child].label_term, nodes_[child].label_begin,
+                nodes_[child].label_begin + common);
+            nodes_[middle].first_child = child;
+            nodes_[middle].min_length = nodes_[child].min_length;
+            nodes_[middle].max_length = nodes_[child].max_length;
+            nodes_[middle].next_sibling = nodes_[child].next_sibling;
+            nodes_[child].next_sibling = NO_NODE;
+            SetLabel(child, nodes_[child].label_term, nodes_[child].label_begin + common, nodes_[child].label_end);
+            (previous == NO_NODE ? nodes_[node].first_child : nodes_[previous].next_sibling) = middle;
+            child = middle;
+        }
+        node = child;
+        position += common;
+    }
+    // Otherwise the rest of the term went into a new leaf
+    if (position == term.size()) {
+        AddLength(nodes_[node], length);
+        if (nodes_[node].term == NO_TERM) {
+            terms_.push_back(term);
+            nodes_[node].term = static_cast<uint32_t>(terms_.size() - 1);
+        }
+    }
+    if (nodes_.size() >= std::max(MIN_RELAYOUT_NODE_COUNT, 2 * laid_out_node_count_)) {
+        Relayout();
+    }
+}
+
+size_t TermTrie::GetTermCount() const {
+    return terms_.size();
+}
+
+size_t TermTrie::GetMemoryUsage() const {
+    return EstimateAllocation(nodes_.capacity() * sizeof(Node))
+        + EstimateAllocation(terms_.capacity() * sizeof(std::string_view));
+}
+
+std::string_view TermTrie::GetLabel(const Node& node) const {
+    const size_t length = node.label_end - node.label_begin;
+    if (length <= SHORT_LABEL_SIZE) {
+        return { node.short_label, length };
+    }
+    return terms_[node.label_term].substr(node.label_begin, length);
+}
+
+void TermTrie::SetLabel(uint32_t node, uint32_t label_term, size_t label_begin, size_t label_end) {
+    nodes_[node].label_term = label_term;
+    nodes_[node].label_begin = static_cast<uint32_t>(label_begin);
+    nodes_[node].label_end = static_cast<uint32_t>(label_end);
+    if (label_end - label_begin <= SHORT_LABEL_SIZE) {
+        terms_[label_term].copy(nodes_[node].short_label, label_end - label_begin, label_begin);
+    }
+}
+
+uint32_t TermTrie::AddNode(uint32_t label_term, size_t label_begin, size_t label_end) {
+    nodes_.emplace_back();
+    SetLabel(static_cast<uint32_t>(nodes_.size() - 1), label_term, label_begin, label_end);
+    return static_cast<uint32_t>(nodes_.size() - 1);
+}
+
+void TermTrie::AddLength(Node& node, uint16_t length) {
+    node.min_length = std::min(node.min_length, length);
+    node.max_length = std::max(node.max_length, length);
+}
+
+void TermTrie::Relayout() {
+    std::vector<Node> nodes;
+    nodes.reserve(nodes_.capacity());
+    nodes.push_back(nodes_[0]);
+    // nodes[i] is the copy of nodes_[order[i]]
+    std::vector<uint32_t> order = { 0 };
+    order.reserve(nodes_.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        uint32_t child = nodes_[order[i]].first_child;
+        if (child == NO_NODE) {
+            continue;
+        }
+        nodes[i].first_child = static_cast<uint32_t>(nodes.size());
+        for (; child != NO_NODE; child = nodes_[child].next_sibling) {
+            order.push_back(child);
+            nodes.push_back(nodes_[child]);
+            if (nodes.back().next_sibling != NO_NODE) {
+                nodes.back().next_sibling = static_cast<uint32_t>(nodes.size());
+            }
+        }
+    }
+    nodes_ = std::move(nodes);
+    laid_out_node_count_ = nodes_.size();
+}
+
+uint32_t TermTrie::FindPrefixNode(std::string_view prefix) const {
+    uint32_t node = 0;
+    size_t position = 0;
+    while (position < prefix.size()) {
+        uint32_t child = nodes_[node].first_child;
+        while (child != NO_NODE && IsByteBefore(GetLabel(nodes_[child])[0], prefix[position])) {
+            child = nodes_[child].next_sibling;
+        }
+        if (child == NO_NODE) {
+            return NO_NODE;
+        }
+        const std::string_view label = GetLabel(nodes_[child]);
+        const std::string_view rest = prefix.substr(position);
+        const size_t length = std::min(label.size(), rest.size());
+        if (label.substr(0, length) != rest.substr(0, length)) {
+            return NO_NODE;
+        }
+        node = child;
+        position += length;
+    }
+    return node;
+}
+
+namespace {
+
+// Number of bytes of the UTF-8 sequence started by the byte. Stray bytes are
+// taken as one-byte characters.
+int GetSequenceLength(unsigned char byte) {
+    if (byte >= 0xF0 && byte < 0xF8) {
+        return 4;
+    }
+    if (byte >= 0xE0 && byte < 0xF0) {
+        return 3;
+    }
+    if (byte >= 0xC0 && byte < 0xE0) {
+        return 2;
+    }
+    return 1;
+}
+
+uint16_t CountCodePoints(std::string_view text) {
+    size_t count = 0;
+    for (size_t i = 0; i < text.size(); i += GetSequenceLength(text[i])) {
+        ++count;
+    }
+    return static_cast<uint16_t>(std::min<size_t>(count, UINT16_MAX));
+}
+
+std::vector<uint32_t> DecodeCodePoints(std::string_view text) {
+    std::vector<uint32_t> code_points;
+    for (size_t i = 0; i < text.size();) {
+        const size_t length = std::min<size_t>(GetSequenceLength(text[i]), text.size() - i);
+        uint32_t code_point = 0;
+        for (size_t j = 0; j < length; ++j) {
+            code_point = code_point << 8 | static_cast<unsigned char>(text[i + j]);
+        }
+        code_points.push_back(code_point);
+        i += length;
+    }
+    return code_points;
+}
+
+}
+
+struct TermTrie::FuzzySearch {
+    std::vector<uint32_t> word;
+    int max_distance;
+    // Row d of the edit distance table starts at rows[d * (word.size() + 1)]
+    std::vector<int> rows;
+    size_t visits_left;
+    std::vector<std::pair<std::string_view, int>> result;
+};
+
+std::vector<std::pair<std::string_view, int>> TermTrie::FindWithinDistance(std::string_view word, int max_distance,
+    size_t max_visited_nodes) const {
+    FuzzySearch search{ DecodeCodePoints(word), max_distance, {}, max_visited_nodes, {} };
+    const size_t width = search.word.size() + 1;
+    search.rows.resize(width * (width + max_distance + 1));
+    for (size_t i = 0; i < width; ++i) {
+        search.rows[i] = static_cast<int>(i);
+    }
+    if (nodes_[0].term != NO_TERM && search.rows[width - 1] <= max_distance) {
+        search.result.emplace_back(terms_[nodes_[0].term], search.rows[width - 1]);
+    }
+    FindWithinDistance(0, 0, 0, 0, search);
+    return search.result;
+}
+
+bool TermTrie::CanMatchSubtree(const Node& node, size_t depth, const FuzzySearch& search) const {
+    // A term of length n ends at row n of the table, and from cell i of the
+    // current row at least |(n - depth) - (word size - i)| more edits are needed
+    const size_t word_size = search.word.size();
+    const size_t first = depth > static_cast<size_t>(search.max_distance) ? depth - search.max_distance : 0;
+    const size_t last = std::min(word_size, depth + search.max_distance);
+    const size_t min_rest = node.min_length > depth ? node.min_length - depth : 0;
+    const size_t max_rest = node.max_length > depth ? node.max_length - depth : 0;
+    const int* row = search.rows.data() + depth * (word_size + 1);
+    for (size_t i = first; i <= last; ++i) {
+        const size_t word_rest = word_size - i;
+        const size_t gap = word_rest < min_rest ? min_rest - word_rest
+            : word_rest > max_rest ? word_rest - max_rest : 0;
+        if (row[i] + gap <= static_cast<size_t>(search.max_distance)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void TermTrie::FindWithinDistance(uint32_t node, size_t depth, uint32_t code_point, int pending_bytes,
+    FuzzySearch& search) const {
+    const size_t width = search.word.size() + 1;
+    for (uint32_t child = nodes_[node].first_child; child != NO_NODE; child = nodes_[child].next_sibling) {
+        if (search.visits_left == 0) {
+            return;
+        }
+        --search.visits_left;
+        if (!CanMatchSubtree(nodes_[child], depth, search)) {
+            continue;
+        }
+        size_t child_depth = depth;
+        uint32_t child_code_point = code_point;
+        int child_pending_bytes = pending_bytes;
+        bool reachable = true;
+        // Labels may end inside a multi-byte character, which is then
+        // completed in the children
+        for (const char c : GetLabel(nodes_[child])) {
+            const unsigned char byte = static_cast<unsigned char>(c);
+            if (child_pending_bytes == 0) {
+                child_pending_bytes = GetSequenceLength(byte);
+                child_code_point = 0;
+            }
+            child_code_point = child_code_point << 8 | byte;
+            if (--child_pending_bytes > 0) {
+                continue;
+            }
+            // Terms longer than the word by more than the distance never match
+            if (child_depth + 1 >= width + search.max_distance) {
+                reachable = false;
+                break;
+            }
+            // Only the cells within max_distance of the diagonal can stay
+            // within the distance, the ones around the band are capped
+            const int cap = search.max_distance + 1;
+            const size_t row = child_depth + 1;
+            const size_t first = std::max<size_t>(1, row > static_cast<size_t>(search.max_distance)
+                ? row - search.max_distance : 1);
+            const size_t last = std::min(width - 1, row + search.max_distance);
+            const int* previous = search.rows.data() + child_depth * width;
+            int* current = search.rows.data() + row * width;
+            current[first - 1] = first == 1 ? std::min<int>(previous[0] + 1, cap) : cap;
+            int row_min = current[first - 1];
+            for (size_t i = first; i <= last; ++i) {
+                const int substitution = previous[i - 1] + (search.word[i - 1] != child_code_point ? 1 : 0);
+                current[i] = std::min({ previous[i] + 1, current[i - 1] + 1, substitution, cap });
+                row_min = std::min(row_min, current[i]);
+            }
+            if (last + 1 < width) {
+                current[last + 1] = cap;
+            }
+            ++child_depth;
+            if (row_min > search.max_distance) {
+                reachable = false;
+                break;
+            }
+        }
+        if (!reachable) {
+            continue;
+        }
+        const int distance = child_depth + search.max_distance + 1 >= width
+            ? search.rows[child_depth * width + width - 1] : search.max_distance + 1;
+        if (child_pending_bytes == 0 && nodes_[child].term != NO_TERM && distance <= search.max_distance) {
+            search.result.emplace_back(terms_[nodes_[child].term], distance);
+        }
+        FindWithinDistance(child, child_depth, child_code_point, child_pending_bytes, search);
+    }
+}
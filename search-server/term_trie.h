@@ -0,0 +1,106 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Path-compressed trie over the term dictionary. Edge labels are not copied:
+// each one is a slice of a term inserted below it, so a node is a few indices
+// and the vocabulary text is shared with the index. Inserted terms must
+// outlive the trie. Whenever the node count doubles, the nodes are laid out
+// again breadth first, so that the siblings a walk visits one after another
+// are adjacent in memory instead of scattered in insertion order.
+class TermTrie {
+public:
+    TermTrie();
+
+    void Insert(std::string_view term);
+    size_t GetTermCount() const;
+    size_t GetMemoryUsage() const;
+
+    // Calls function(term) in lexicographic order for the terms that start
+    // with the prefix, until the function returns false
+    template <typename Function>
+    void ForEachWithPrefix(std::string_view prefix, Function function) const;
+
+    // Terms within max_distance Levenshtein edits of the word, counted in UTF-8
+    // code points, with their distances. The trie is walked with one row of
+    // the edit distance table per code point, so a subtree is left as soon as
+    // no term in it can come within the distance: when the band of the row
+    // exceeds it, or when the term lengths of the subtree are too far from
+    // the length of the word left to match. The walk stops after visiting
+    // max_visited_nodes nodes, the terms found by then are returned.
+    std::vector<std::pair<std::string_view, int>> FindWithinDistance(std::string_view word, int max_distance,
+        size_t max_visited_nodes = SIZE_MAX) const;
+
+private:
+    static constexpr uint32_t NO_NODE = UINT32_MAX;
+    static constexpr uint32_t NO_TERM = UINT32_MAX;
+    static constexpr size_t SHORT_LABEL_SIZE = 8;
+    static constexpr size_t MIN_RELAYOUT_NODE_COUNT = 1024;
+
+    struct Node {
+        uint32_t first_child = NO_NODE;
+        uint32_t next_sibling = NO_NODE;
+        uint32_t term = NO_TERM;
+        // The label is terms_[label_term].substr(label_begin, label_end - label_begin).
+        // Short labels are also copied into the node to save the walks two
+        // cache misses per visited node.
+        uint32_t label_term = 0;
+        uint32_t label_begin = 0;
+        uint32_t label_end = 0;
+        // Shortest and longest term of the subtree in code points, saturated
+        uint16_t min_length = UINT16_MAX;
+        uint16_t max_length = 0;
+        char short_label[SHORT_LABEL_SIZE] = {};
+    };
+
+    std::string_view GetLabel(const Node& node) const;
+    void SetLabel(uint32_t node, uint32_t label_term, size_t label_begin, size_t label_end);
+    uint32_t AddNode(uint32_t label_term, size_t label_begin, size_t label_end);
+    static void AddLength(Node& node, uint16_t length);
+    // Reorders the nodes breadth first with the children of a node adjacent
+    void Relayout();
+    // Node whose path covers the prefix, NO_NODE if no term starts with it
+    uint32_t FindPrefixNode(std::string_view prefix) const;
+
+    struct FuzzySearch;
+    // Whether a term of the subtree can still come within the distance of
+    // the word, given the row of the table at the depth of the node's parent
+    bool CanMatchSubtree(const Node& node, size_t depth, const FuzzySearch& search) const;
+    void FindWithinDistance(uint32_t node, size_t depth, uint32_t code_point, int pending_bytes,
+        FuzzySearch& search) const;
+
+    std::vector<Node> nodes_;
+    std::vector<std::string_view> terms_;
+    size_t laid_out_node_count_ = 0;
+};
+
+template <typename Function>
+void TermTrie::ForEachWithPrefix(std::string_view prefix, Function function) const {
+    const uint32_t start = FindPrefixNode(prefix);
+    if (start == NO_NODE) {
+        return;
+    }
+    if (nodes_[start].term != NO_TERM && !function(terms_[nodes_[start].term])) {
+        return;
+    }
+    std::vector<uint32_t> stack;
+    if (nodes_[start].first_child != NO_NODE) {
+        stack.push_back(nodes_[start].first_child);
+    }
+    while (!stack.empty()) {
+        const Node& node = nodes_[stack.back()];
+        stack.pop_back();
+        if (node.next_sibling != NO_NODE) {
+            stack.push_back(node.next_sibling);
+        }
+        if (node.first_child != NO_NODE) {
+            stack.push_back(node.first_child);
+        }
+        if (node.term != NO_TERM && !function(terms_[node.term])) {
+            return;
+        }
+    }
+}
@@ -1,7 +1,24 @@
 #pragma once
 
 #include "search_server.h"
+#include "counting_memory_resource.h"
+#include "ingestion.h"
+#include "process_queries.h"
+#include "request_queue.h"
+#include "mapped_file.h"
+#include "stop_word_set.h"
+#include "analyzer.h"
+#include "term_trie.h"
+#include "paginator.h"
+#include "segmented_search_server.h"
+#include "shard_router.h"
+#include "shard_server.h"
 #include <assert.h>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
 
 using namespace std;
 
@@ -253,6 +270,17 @@ void TestComputeAverageRating() {
 		ASSERT_EQUAL(doc1.rating, 6);
 		ASSERT_EQUAL(doc2.rating, 2);
 	}
+	// A document without ratings is rated 0 instead of dividing by zero
+	{
+		ASSERT_EQUAL(ComputeAverageRating({}), 0);
+		SearchServer server("in the"s);
+		server.AddDocument(doc_id1, content1, DocumentStatus::ACTUAL, {});
+		ASSERT_EQUAL(server.FindTopDocuments("city"s).front().rating, 0);
+		server.UpdateRating(doc_id1, ratings2);
+		ASSERT_EQUAL(server.FindTopDocuments("city"s).front().rating, 6);
+		server.UpdateRating(doc_id1, {});
+		ASSERT_EQUAL(server.FindTopDocuments("city"s).front().rating, 0);
+	}
 }
 
 void TestResultFilterPredicate() {
@@ -369,6 +397,1352 @@ void TestCorrectRelevance() {
 
 }
 
+void TestShardProtocol() {
+	vector<ShardRequest> requests(2);
+	requests[0].type = ShardRequestType::FIND_TOP_DOCUMENTS;
+	requests[0].raw_query = "fluffy cat"s;
+	requests[0].status = DocumentStatus::BANNED;
+	requests[0].global_statistics.document_count = 3;
+	requests[0].global_statistics.document_freqs["cat"s] = 2;
+	requests[1].type = ShardRequestType::MATCH_DOCUMENT;
+	requests[1].raw_query = "dog"s;
+	requests[1].document_id = 7;
+	const auto decoded = DecodeRequests(EncodeRequests(requests));
+	ASSERT_EQUAL(decoded.size(), 2u);
+	ASSERT(decoded[0].status == DocumentStatus::BANNED);
+	ASSERT_EQUAL(decoded[0].global_statistics.document_freqs.at("cat"s), 2);
+	ASSERT_EQUAL(decoded[1].document_id, 7);
+
+	// A corrupt count is rejected before anything is allocated for it
+	BinaryWriter huge_count;
+	huge_count.WriteU32(0xFFFFFFFFu);
+	try {
+		DecodeRequests(huge_count.GetBuffer());
+		ASSERT_HINT(false, "A count larger than the message must be rejected"s);
+	}
+	catch (const out_of_range&) {
+	}
+	vector<ShardResponse> responses(2);
+	responses[0].documents = { { 1, 0.5, 3 } };
+	responses[1].document_found = true;
+	responses[1].status = DocumentStatus::REMOVED;
+	string payload = EncodeResponses(requests, responses);
+	ASSERT(DecodeResponses(requests, payload)[1].status == DocumentStatus::REMOVED);
+	payload[payload.size() - 5] = static_cast<char>(static_cast<uint8_t>(DocumentStatus::REMOVED) + 1);
+	try {
+		DecodeResponses(requests, payload);
+		ASSERT_HINT(false, "Unknown statuses must be rejected"s);
+	}
+	catch (const invalid_argument&) {
+	}
+}
+
+#ifndef _WIN32
+void TestShardRouter() {
+	const vector<string> contents = {
+		"white cat and fashionable collar"s,
+		"fluffy cat fluffy tail"s,
+		"groomed dog expressive eyes"s,
+		"groomed starling evgeny"s,
+		"dog with a long tail"s,
+		"cat on the roof"s,
+	};
+	SearchServer whole("and with"s);
+	SearchServer shard0("and with"s);
+	SearchServer shard1("and with"s);
+	for (int id = 0; id < static_cast<int>(contents.size()); ++id) {
+		whole.AddDocument(id, contents[id], DocumentStatus::ACTUAL, { id, 1 });
+		(id % 2 == 0 ? shard0 : shard1).AddDocument(id, contents[id], DocumentStatus::ACTUAL, { id, 1 });
+	}
+	// Exact ties across shards: the merge must break them by id like a single server
+	for (const int id : { 6, 7 }) {
+		whole.AddDocument(id, "sparrow in the garden"s, DocumentStatus::ACTUAL, { 5 });
+		(id % 2 == 0 ? shard0 : shard1).AddDocument(id, "sparrow in the garden"s, DocumentStatus::ACTUAL, { 5 });
+	}
+
+	ShardServer server0(shard0, "/tmp/search-server-test-shard-0.sock"s);
+	ShardServer server1(shard1, "/tmp/search-server-test-shard-1.sock"s);
+	thread thread0([&server0] { server0.Run(); });
+	thread thread1([&server1] { server1.Run(); });
+	{
+		ShardRouter router({ server0.GetSocketPath(), server1.GetSocketPath() });
+		const vector<string> queries = { "fluffy groomed cat"s, "dog tail -fluffy"s, "roof"s, "parrot"s, "garden sparrow"s };
+		const auto batch = router.FindTopDocuments(queries);
+		ASSERT_EQUAL(batch.size(), queries.size());
+		for (size_t i = 0; i < queries.size(); ++i) {
+			const auto expected = whole.FindTopDocuments(queries[i]);
+			ASSERT_EQUAL_HINT(batch[i].size(), expected.size(), "Sharded results must match a single server"s);
+			for (size_t j = 0; j < expected.size(); ++j) {
+				ASSERT_EQUAL(batch[i][j].id, expected[j].id);
+				ASSERT(abs(batch[i][j].relevance - expected[j].relevance) < EPS);
+			}
+		}
+
+		const auto [words, status] = router.MatchDocument("fluffy cat parrot"s, 1);
+		ASSERT_EQUAL(words.size(), 2u);
+		ASSERT(status == DocumentStatus::ACTUAL);
+		try {
+			router.MatchDocument("cat"s, 100);
+			ASSERT_HINT(false, "Unknown document must be reported"s);
+		}
+		catch (const out_of_range&) {
+		}
+	}
+	server0.Stop();
+	server1.Stop();
+	thread0.join();
+	thread1.join();
+}
+#endif
+
+void TestSegmentedSearchServer() {
+	const vector<string> contents = {
+		"white cat and fashionable collar"s,
+		"fluffy cat fluffy tail"s,
+		"groomed dog expressive eyes"s,
+		"groomed starling evgeny"s,
+		"dog with a long tail"s,
+		"cat on the roof"s,
+		"big dog and small cat"s,
+		"parrot on the big roof"s,
+		"starling in the garden"s,
+		"sparrow in the garden"s,
+		"sparrow in the garden"s,
+		"sparrow in the garden"s,
+	};
+	SearchServer expected("and with"s);
+	SegmentedIndexOptions merge_options;
+	merge_options.max_mutable_documents = 2;
+	merge_options.merge_factor = 2;
+	SegmentedSearchServer segmented("and with"s, merge_options);
+	for (int id = 0; id < static_cast<int>(contents.size()); ++id) {
+		// The sparrows tie exactly on relevance and rating, the order falls back to the id
+		const vector<int> ratings = id < 9 ? vector<int>{ id, 2 } : vector<int>{ 5 };
+		expected.AddDocument(id, contents[id], id % 3 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, ratings);
+		segmented.AddDocument(id, contents[id], id % 3 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, ratings);
+	}
+	for (const int id : { 1, 8 }) {
+		expected.RemoveDocument(id);
+		segmented.RemoveDocument(id);
+	}
+	segmented.Flush();
+	segmented.WaitForMerges();
+	ASSERT_EQUAL(segmented.GetDocumentCount(), expected.GetDocumentCount());
+	ASSERT_HINT(segmented.GetSegmentCount() < 4u, "Sealed segments must be merged in the background"s);
+
+	for (const auto& query : { "cat tail"s, "groomed starling -dog"s, "big roof"s, "fluffy"s, "dog -tail -eyes"s,
+			"sparrow garden"s }) {
+		for (const DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::BANNED }) {
+			for (const QueryMode mode : { QueryMode::ANY, QueryMode::ALL }) {
+				SearchOptions search_options;
+				search_options.mode = mode;
+				const auto lhs = segmented.FindTopDocuments(query, mode,
+					[status](int, DocumentStatus document_status, int) {
+						return document_status == status;
+					});
+				const auto rhs = expected.FindTopDocuments(query, status, search_options);
+				ASSERT_EQUAL_HINT(lhs.size(), rhs.size(), query);
+				for (size_t i = 0; i < lhs.size(); ++i) {
+					ASSERT_EQUAL(lhs[i].id, rhs[i].id);
+					ASSERT_EQUAL(lhs[i].rating, rhs[i].rating);
+					ASSERT(abs(lhs[i].relevance - rhs[i].relevance) < EPS);
+				}
+			}
+		}
+	}
+
+	// Both servers analyze text and parse queries with the same TextProcessor
+	TextAnalysis analysis;
+	analysis.fold_case = true;
+	analysis.split_on_whitespace = true;
+	SearchServer expected_folded("And"s, analysis);
+	SegmentedIndexOptions options;
+	options.analysis = analysis;
+	SegmentedSearchServer segmented_folded("And"s, options);
+	for (int id = 0; id < static_cast<int>(contents.size()); ++id) {
+		string content = contents[id];
+		replace(content.begin(), content.end(), ' ', id % 2 == 0 ? '\t' : ' ');
+		content[0] = static_cast<char>(toupper(content[0]));
+		expected_folded.AddDocument(id, content, DocumentStatus::ACTUAL, {});
+		segmented_folded.AddDocument(id, content, DocumentStatus::ACTUAL, {});
+	}
+	const auto lhs = segmented_folded.FindTopDocuments("WHITE\tcat  AND -Roof"s);
+	const auto rhs = expected_folded.FindTopDocuments("WHITE\tcat  AND -Roof"s);
+	ASSERT_EQUAL(lhs.size(), rhs.size());
+	for (size_t i = 0; i < lhs.size(); ++i) {
+		ASSERT_EQUAL(lhs[i].id, rhs[i].id);
+		ASSERT(abs(lhs[i].relevance - rhs[i].relevance) < EPS);
+	}
+	for (const auto& query : { "cat --dog"s, "cat -"s, "ca\x01t"s }) {
+		bool expected_throws = false;
+		bool segmented_throws = false;
+		try {
+			expected_folded.FindTopDocuments(query);
+		}
+		catch (const invalid_argument&) {
+			expected_throws = true;
+		}
+		try {
+			segmented_folded.FindTopDocuments(query);
+		}
+		catch (const invalid_argument&) {
+			segmented_throws = true;
+		}
+		ASSERT_HINT(expected_throws && segmented_throws, query);
+	}
+}
+
+void TestCompressedPostingList() {
+	vector<pair<uint32_t, double>> postings;
+	for (uint32_t document = 3, i = 0; i < 1000; ++i, document += 1 + (i * 7) % 13) {
+		postings.emplace_back(document, 1.0 / (1 + i % 70));
+	}
+	for (const TermFreqEncoding encoding : { TermFreqEncoding::FLOAT32, TermFreqEncoding::QUANTIZED_16, TermFreqEncoding::QUANTIZED_8 }) {
+		const CompressedPostingList list(postings, encoding);
+		ASSERT_EQUAL(list.size(), postings.size());
+		const double max_error = encoding == TermFreqEncoding::QUANTIZED_8 ? 1.0 / 255 : 1.0 / 65535;
+		size_t i = 0;
+		list.ForEach([&](uint32_t document, double term_freq) {
+			ASSERT_EQUAL(document, postings[i].first);
+			ASSERT(abs(term_freq - postings[i].second) <= max_error);
+			++i;
+			});
+		ASSERT_EQUAL(i, postings.size());
+
+		CompressedPostingList::Cursor cursor(list);
+		for (const size_t target : { 0u, 5u, 500u, 501u, 999u }) {
+			cursor.SkipTo(postings[target].first);
+			ASSERT(!cursor.AtEnd());
+			ASSERT_EQUAL(cursor.GetDocument(), postings[target].first);
+			cursor.SkipTo(postings[target].first + 1);
+			if (target + 1 < postings.size()) {
+				ASSERT_EQUAL(cursor.GetDocument(), postings[target + 1].first);
+			}
+		}
+		cursor.SkipTo(postings.back().first + 1);
+		ASSERT(cursor.AtEnd());
+	}
+	const CompressedPostingList compact(postings, TermFreqEncoding::QUANTIZED_8);
+	ASSERT_HINT(compact.GetMemoryUsage() * 10 < postings.size() * 48, "A posting must take a fraction of a map node"s);
+}
+
+void TestMemoryStats() {
+	SearchServer server("in the"s);
+	const MemoryStats empty = server.GetMemoryStats();
+	ASSERT_EQUAL(empty.posting_count, 0u);
+	ASSERT(empty.stop_words > 0);
+
+	server.AddDocument(1, "cat in the city"s, DocumentStatus::ACTUAL, { 1 });
+	server.AddDocument(2, "city cat is big and the cat is white"s, DocumentStatus::ACTUAL, { 2 });
+	server.AddDocument(3, "dog in the city of a thousand lights"s, DocumentStatus::BANNED, { 3 });
+	const MemoryStats stats = server.GetMemoryStats(2);
+	ASSERT_EQUAL(stats.term_count, 11u);
+	ASSERT_EQUAL(stats.posting_count, 14u);
+	ASSERT(stats.inverted_index > empty.inverted_index);
+	ASSERT(stats.forward_index > 0 && stats.document_attributes > 0 && stats.retained_text > 0);
+	ASSERT_EQUAL(stats.total, sizeof(SearchServer) + stats.inverted_index + stats.forward_index
+		+ stats.document_attributes + stats.retained_text + stats.stop_words);
+	ASSERT_EQUAL(stats.largest_posting_lists.size(), 2u);
+	ASSERT_EQUAL(stats.largest_posting_lists[0].first, "city"s);
+	ASSERT_EQUAL(stats.largest_posting_lists[0].second, 3u);
+	ASSERT_EQUAL(stats.largest_posting_lists[1].first, "cat"s);
+	ASSERT(!stats.resource_bytes_in_use.has_value());
+
+	// Allocations through a counting resource are measured, also from a pool
+	CountingMemoryResource upstream;
+	pmr::unsynchronized_pool_resource pool(&upstream);
+	CountingMemoryResource counting(&pool);
+	{
+		SearchServer counted("in the"s, TextAnalysis{}, &counting);
+		counted.AddDocument(1, "cat in the city"s, DocumentStatus::ACTUAL, { 1 });
+		counted.AddDocument(2, "city cat is big and the cat is white"s, DocumentStatus::ACTUAL, { 2 });
+		const MemoryStats measured = counted.GetMemoryStats();
+		ASSERT(measured.resource_bytes_in_use.has_value());
+		ASSERT_EQUAL(*measured.resource_bytes_in_use, counting.GetBytesInUse());
+		ASSERT(*measured.resource_bytes_in_use > 0);
+	}
+	ASSERT_EQUAL(counting.GetBytesInUse(), 0u);
+}
+
+void TestStatusFilterPushdown() {
+	SearchServer server("in the"s);
+	for (int id = 0; id < 200; ++id) {
+		const DocumentStatus status = id % 50 == 7 ? DocumentStatus::BANNED
+			: id % 3 == 0 ? DocumentStatus::IRRELEVANT : DocumentStatus::ACTUAL;
+		const string content = id % 2 == 0 ? "cat in the big city"s : "dog and cat near the city river"s;
+		server.AddDocument(id, content + " word"s + to_string(id % 11), status, { id });
+	}
+	server.RemoveDocument(57);
+	for (const auto& query : { "city"s, "cat river -big"s, "word3 dog"s, "unknown"s }) {
+		for (const DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::IRRELEVANT, DocumentStatus::BANNED }) {
+			const auto fast = server.FindTopDocuments(query, status);
+			const auto generic = server.FindTopDocuments(query, [status](int, DocumentStatus document_status, int) {
+				return document_status == status;
+				});
+			ASSERT_EQUAL_HINT(fast.size(), generic.size(), query);
+			for (size_t i = 0; i < fast.size(); ++i) {
+				ASSERT_EQUAL(fast[i].id, generic[i].id);
+				ASSERT(abs(fast[i].relevance - generic[i].relevance) < EPS);
+			}
+			const auto parallel = server.FindTopDocuments(execution::par, query, status);
+			ASSERT_EQUAL(parallel.size(), fast.size());
+		}
+	}
+	const auto banned = server.FindTopDocuments("city"s, DocumentStatus::BANNED);
+	ASSERT_EQUAL(banned.size(), 3u);
+	for (const Document& document : banned) {
+		ASSERT_EQUAL(document.id % 50, 7);
+	}
+}
+
+void TestDocumentFilter() {
+	SearchServer server("and"s);
+	for (int id = 0; id < 150; ++id) {
+		const DocumentStatus status = static_cast<DocumentStatus>(id % 4);
+		server.AddDocument(id, "white cat and fluffy tail"s + (id % 5 == 0 ? " dog"s : ""s), status, { id % 7 - 2 });
+	}
+	server.RemoveDocument(12);
+
+	DocumentFilter filter;
+	filter.min_rating = 3;
+	filter.statuses = { DocumentStatus::ACTUAL, DocumentStatus::IRRELEVANT };
+	for (const auto& query : { "cat"s, "fluffy dog"s, "cat -dog"s }) {
+		const auto filtered = server.FindTopDocuments(query, filter);
+		const auto expected = server.FindTopDocuments(query, [](int, DocumentStatus status, int rating) {
+			return rating >= 3 && (status == DocumentStatus::ACTUAL || status == DocumentStatus::IRRELEVANT);
+			});
+		ASSERT_EQUAL_HINT(filtered.size(), expected.size(), query);
+		for (size_t i = 0; i < filtered.size(); ++i) {
+			ASSERT_EQUAL(filtered[i].id, expected[i].id);
+		}
+		ASSERT_EQUAL(server.FindTopDocuments(execution::par, query, filter).size(), expected.size());
+	}
+	ASSERT(server.FindTopDocuments("cat"s, DocumentFilter{ 10, 20, {} }).empty());
+	ASSERT_EQUAL(server.FindTopDocuments("cat"s, DocumentFilter{}).size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+
+	vector<int> ratings(131);
+	for (size_t i = 0; i < ratings.size(); ++i) {
+		ratings[i] = static_cast<int>(i % 9) - 4;
+	}
+	vector<uint64_t> words(3);
+	FilterRatingRange(ratings.data(), ratings.size(), -1, 2, words.data());
+	for (size_t i = 0; i < ratings.size(); ++i) {
+		ASSERT_EQUAL(((words[i / 64] >> (i % 64)) & 1) != 0, ratings[i] >= -1 && ratings[i] <= 2);
+	}
+	ASSERT_EQUAL(words[2] >> 3, 0u);
+}
+
+void TestMinusWordsExcludeBeforeScoring() {
+	SearchServer server(""s);
+	for (int id = 0; id < 300; ++id) {
+		server.AddDocument(id * 2, "common word"s + (id % 10 == 0 ? " rare"s : ""s) + (id % 4 == 0 ? " noise"s : ""s),
+			DocumentStatus::ACTUAL, { id % 10 });
+	}
+	for (const auto& documents : { server.FindTopDocuments("rare common -noise"s),
+		server.FindTopDocuments(execution::par, "rare common -noise"s) }) {
+		ASSERT_EQUAL(documents.size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+		for (const Document& document : documents) {
+			const auto [words, status] = server.MatchDocument("noise"s, document.id);
+			ASSERT(words.empty());
+			ASSERT_EQUAL((document.id / 2) % 10, 0);
+		}
+	}
+	ASSERT(server.FindTopDocuments("rare -word"s).empty());
+	ASSERT(server.FindTopDocuments(execution::par, "rare -word"s).empty());
+}
+
+void TestPagedSearch() {
+	SearchServer server("and"s);
+	for (int id = 0; id < 40; ++id) {
+		server.AddDocument(id, "cat"s + string(id % 7 + 1, 'a') + " cat dog"s, DocumentStatus::ACTUAL, { id % 5 });
+	}
+	const auto all = server.FindTopDocuments("cat"s, DocumentStatus::ACTUAL, 0, 100);
+	ASSERT_EQUAL(all.size(), 40u);
+	const auto top = server.FindTopDocuments("cat"s);
+	for (size_t i = 0; i < top.size(); ++i) {
+		ASSERT_EQUAL(top[i].id, all[i].id);
+	}
+	vector<int> paged_ids;
+	for (size_t offset = 0; offset < all.size(); offset += 7) {
+		const auto page = server.FindTopDocuments(execution::par, "cat"s, DocumentStatus::ACTUAL, offset, 7);
+		ASSERT(page.size() <= 7u);
+		for (const Document& document : page) {
+			paged_ids.push_back(document.id);
+		}
+	}
+	ASSERT_EQUAL(paged_ids.size(), all.size());
+	for (size_t i = 0; i < all.size(); ++i) {
+		ASSERT_EQUAL(paged_ids[i], all[i].id);
+	}
+	ASSERT(server.FindTopDocuments("cat"s, DocumentStatus::ACTUAL, 40, 5).empty());
+	// An unbounded limit does not wrap around past a non-zero offset
+	const auto ranked = server.FindTopDocuments("cataa cat"s, DocumentStatus::ACTUAL, 0, 100);
+	ASSERT_EQUAL(ranked.size(), 40u);
+	const auto tail = server.FindTopDocuments("cataa cat"s, DocumentStatus::ACTUAL, 3, numeric_limits<size_t>::max());
+	ASSERT_EQUAL(tail.size(), ranked.size() - 3);
+	ASSERT_EQUAL(tail.front().id, ranked[3].id);
+
+	const LazyPaginator pages(all.begin(), all.end(), 6);
+	ASSERT_EQUAL(pages.size(), 7u);
+	ASSERT_EQUAL(pages.GetPage(6).size(), 4u);
+	ASSERT_EQUAL(pages.GetPage(3).begin()->id, all[18].id);
+	size_t visited = 0;
+	for (const auto page : PaginateLazily(all, 6)) {
+		visited += page.size();
+	}
+	ASSERT_EQUAL(visited, all.size());
+	try {
+		pages.GetPage(7);
+		ASSERT_HINT(false, "Page past the end must throw"s);
+	}
+	catch (const out_of_range&) {
+	}
+}
+
+void TestPrefixQuery() {
+	TermTrie trie;
+	const vector<string> terms = { "cat"s, "cats"s, "catalog"s, "car"s, "dog"s, "ca"s, "category"s };
+	for (const string& term : terms) {
+		trie.Insert(term);
+	}
+	trie.Insert(terms[1]);
+	ASSERT_EQUAL(trie.GetTermCount(), terms.size());
+	vector<string_view> found;
+	trie.ForEachWithPrefix("cat"s, [&found](string_view term) {
+		found.push_back(term);
+		return true;
+		});
+	ASSERT_EQUAL(found, (vector<string_view>{ "cat"sv, "catalog"sv, "category"sv, "cats"sv }));
+	found.clear();
+	trie.ForEachWithPrefix("c"s, [&found](string_view term) {
+		found.push_back(term);
+		return found.size() < 2;
+		});
+	ASSERT_EQUAL(found, (vector<string_view>{ "ca"sv, "car"sv }));
+	found.clear();
+	trie.ForEachWithPrefix("catz"s, [&found](string_view term) {
+		found.push_back(term);
+		return true;
+		});
+	ASSERT(found.empty());
+
+	// Bytes above 0x7F sort after ASCII, as in string comparison: UTF-8
+	// Cyrillic and single-byte Latin-1 terms next to ASCII ones
+	TermTrie mixed_trie;
+	const vector<string> mixed_terms = { "\xD0\xBA\xD0\xBE\xD1\x82"s, "cat"s, "caf\xC3\xA9"s, "\xE9t\xE9"s,
+		"\xD0\xBA\xD0\xB0\xD1\x82"s, "zebra"s, "caf\xE9"s, "cafe"s, "\xD1\x91\xD0\xB6"s };
+	for (const string& term : mixed_terms) {
+		mixed_trie.Insert(term);
+	}
+	// The trie keeps views of the terms, so the expected order is sorted apart
+	vector<string> sorted_terms = mixed_terms;
+	sort(sorted_terms.begin(), sorted_terms.end());
+	vector<string> ordered;
+	mixed_trie.ForEachWithPrefix(""sv, [&ordered](string_view term) {
+		ordered.emplace_back(term);
+		return true;
+		});
+	ASSERT_EQUAL(ordered, sorted_terms);
+	ordered.clear();
+	mixed_trie.ForEachWithPrefix("\xD0"sv, [&ordered](string_view term) {
+		ordered.emplace_back(term);
+		return true;
+		});
+	ASSERT_EQUAL(ordered, (vector<string>{ "\xD0\xBA\xD0\xB0\xD1\x82"s, "\xD0\xBA\xD0\xBE\xD1\x82"s }));
+
+	SearchServer server("and with"s);
+	server.AddDocument(1, "black cat"s, DocumentStatus::ACTUAL, { 1 });
+	server.AddDocument(2, "catalog of dogs"s, DocumentStatus::ACTUAL, { 2 });
+	server.AddDocument(3, "brown dog"s, DocumentStatus::ACTUAL, { 3 });
+	server.AddDocument(4, "two cats and mouse"s, DocumentStatus::ACTUAL, { 4 });
+	ASSERT_EQUAL(server.FindTopDocuments("cat*"s).size(), 3u);
+	ASSERT_EQUAL(server.FindTopDocuments("dog* -cat*"s).size(), 1u);
+	const string match_query = "cat* mouse"s;
+	const auto [words, status] = server.MatchDocument(match_query, 4);
+	ASSERT_EQUAL(words, (vector<string_view>{ "cats"sv, "mouse"sv }));
+	server.RemoveDocument(2);
+	ASSERT_EQUAL(server.FindTopDocuments("cata*"s).size(), 0u);
+	try {
+		server.FindTopDocuments("*"s);
+		ASSERT_HINT(false, "Empty prefix must be rejected"s);
+	}
+	catch (const invalid_argument&) {
+	}
+
+	SearchServer wide(""s);
+	for (int id = 0; id < 100; ++id) {
+		wide.AddDocument(id, "term"s + to_string(id), DocumentStatus::ACTUAL, { 1 });
+	}
+	const auto [expanded, _] = wide.MatchDocument("term*"s, 0);
+	ASSERT_EQUAL(expanded.size(), 1u);
+	ASSERT_EQUAL(wide.GetTermStatistics("term*"s).document_freqs.size(), MAX_PREFIX_EXPANSION);
+}
+
+void TestFuzzySearch() {
+	TermTrie trie;
+	const vector<string> terms = { "кошка"s, "кошки"s, "мошка"s, "кот"s, "cat"s, "cast"s, "dog"s };
+	for (const string& term : terms) {
+		trie.Insert(term);
+	}
+	auto within = trie.FindWithinDistance("кошка"s, 1);
+	sort(within.begin(), within.end());
+	ASSERT_EQUAL(within.size(), 3u);
+	ASSERT_EQUAL(within[0].first, "кошка"s);
+	ASSERT_EQUAL(within[0].second, 0);
+	ASSERT_EQUAL(within[1].first, "кошки"s);
+	ASSERT_EQUAL(within[1].second, 1);
+	ASSERT_EQUAL(within[2].first, "мошка"s);
+	ASSERT_EQUAL(trie.FindWithinDistance("cat"s, 1).size(), 2u);
+	ASSERT_EQUAL(trie.FindWithinDistance("cta"s, 2).size(), 1u);
+	ASSERT(trie.FindWithinDistance("elephant"s, 2).empty());
+
+	// Enough terms for the nodes to be laid out again several times, checked
+	// against a full edit distance table
+	const auto edit_distance = [](const string& lhs, const string& rhs) {
+		vector<size_t> row(rhs.size() + 1);
+		iota(row.begin(), row.end(), 0);
+		for (size_t i = 1; i <= lhs.size(); ++i) {
+			size_t diagonal = row[0];
+			row[0] = i;
+			for (size_t j = 1; j <= rhs.size(); ++j) {
+				const size_t above = row[j];
+				row[j] = min({ row[j] + 1, row[j - 1] + 1, diagonal + (lhs[i - 1] != rhs[j - 1] ? 1 : 0) });
+				diagonal = above;
+			}
+		}
+		return row.back();
+	};
+	vector<string> many_terms;
+	for (unsigned seed = 1; many_terms.size() < 5000; seed = seed * 1103515245 + 12345) {
+		many_terms.push_back(string(3 + seed % 6, 'a'));
+		for (size_t i = 0; i < many_terms.back().size(); ++i) {
+			many_terms.back()[i] = static_cast<char>('a' + (seed >> (i * 3 + 8)) % 5);
+		}
+	}
+	TermTrie large_trie;
+	for (const string& term : many_terms) {
+		large_trie.Insert(term);
+	}
+	for (const auto& word : { "abc"s, "eeeeee"s, "abcdeab"s }) {
+		auto found = large_trie.FindWithinDistance(word, 2);
+		sort(found.begin(), found.end());
+		found.erase(unique(found.begin(), found.end()), found.end());
+		set<pair<string, int>> expected;
+		for (const string& term : many_terms) {
+			const size_t distance = edit_distance(word, term);
+			if (distance <= 2) {
+				expected.emplace(term, static_cast<int>(distance));
+			}
+		}
+		ASSERT_EQUAL(found.size(), expected.size());
+		auto expected_it = expected.begin();
+		for (const auto& [term, distance] : found) {
+			ASSERT_EQUAL(term, expected_it->first);
+			ASSERT_EQUAL(distance, expected_it->second);
+			++expected_it;
+		}
+	}
+	// A walk cut short returns some of the terms, never wrong ones
+	const auto full = large_trie.FindWithinDistance("abcdeab"s, 2);
+	const auto partial = large_trie.FindWithinDistance("abcdeab"s, 2, 50);
+	ASSERT(!partial.empty() && partial.size() < full.size());
+	for (const auto& found : partial) {
+		ASSERT(find(full.begin(), full.end(), found) != full.end());
+	}
+	ASSERT(large_trie.FindWithinDistance("abcdeab"s, 2, 0).empty());
+
+	SearchServer server("and"s);
+	server.AddDocument(1, "fluffy cat"s, DocumentStatus::ACTUAL, { 1 });
+	server.AddDocument(2, "big cats"s, DocumentStatus::ACTUAL, { 2 });
+	server.AddDocument(3, "brown dog"s, DocumentStatus::ACTUAL, { 3 });
+	ASSERT(server.FindTopDocuments("catt"s).empty());
+	SearchOptions options;
+	options.max_edit_distance = 1;
+	const auto fuzzy = server.FindTopDocuments("catt"s, DocumentStatus::ACTUAL, options);
+	ASSERT_EQUAL(fuzzy.size(), 2u);
+	ASSERT_EQUAL(fuzzy[0].id + fuzzy[1].id, 3);
+	const auto exact_first = server.FindTopDocuments(execution::par, "cats"s, DocumentStatus::ACTUAL, options);
+	ASSERT_EQUAL(exact_first.size(), 2u);
+	ASSERT_EQUAL(exact_first[0].id, 2);
+	ASSERT(exact_first[0].relevance > exact_first[1].relevance);
+	options.max_edit_distance = 3;
+	try {
+		server.FindTopDocuments("cat"s, DocumentStatus::ACTUAL, options);
+		ASSERT_HINT(false, "Edit distance above the limit must be rejected"s);
+	}
+	catch (const invalid_argument&) {
+	}
+}
+
+void TestTextAnalysis() {
+	string text = "Hello WORLD, Кошка И ЁЖ И СТОЛЯ Ё ÉCOLE"s;
+	CaseFoldNormalizer::Normalize(text.data(), text.size());
+	ASSERT_EQUAL(text, "hello world, кошка и ёж и столя ё école"s);
+	vector<string_view> tokens;
+	WhitespaceTokenizer::Tokenize(" a\tb  c\n"sv, [&tokens](string_view token) {
+		tokens.push_back(token);
+		});
+	ASSERT_EQUAL(tokens, (vector<string_view>{ "a"sv, "b"sv, "c"sv }));
+
+	TextAnalysis analysis;
+	analysis.fold_case = true;
+	analysis.split_on_whitespace = true;
+	SearchServer server("И НА"s, analysis);
+	server.AddDocument(1, "Кошка  И\tСобака"s, DocumentStatus::ACTUAL, { 1 });
+	server.AddDocument(2, "белая кошка на окне"s, DocumentStatus::ACTUAL, { 2 });
+	ASSERT_EQUAL(server.FindTopDocuments("КОШКА"s).size(), 2u);
+	ASSERT_EQUAL(server.FindTopDocuments("кошка\t-СОБАКА"s).size(), 1u);
+	ASSERT(server.FindTopDocuments("и"s).empty());
+	const auto [words, status] = server.MatchDocument("Собака КОШКА"s, 1);
+	ASSERT_EQUAL(words, (vector<string_view>{ "кошка"sv, "собака"sv }));
+
+	SearchServer plain("and"s);
+	plain.AddDocument(1, "Cat and dog"s, DocumentStatus::ACTUAL, { 1 });
+	ASSERT(plain.FindTopDocuments("cat"s).empty());
+	ASSERT_EQUAL(plain.FindTopDocuments("Cat"s).size(), 1u);
+}
+
+void TestStopWordSet() {
+	set<string, less<>> words;
+	for (int i = 0; i < 500; ++i) {
+		words.insert("stop"s + to_string(i * 7));
+	}
+	words.insert("a"s);
+	words.insert(string(70, 'x'));
+	const StopWordSet stop_words(words);
+	ASSERT_EQUAL(stop_words.size(), words.size());
+	for (const string& word : words) {
+		ASSERT_HINT(stop_words.Contains(word), word);
+	}
+	for (const auto& word : { ""s, "b"s, "stop1"s, "stop"s, "top7"s, string(70, 'y'), string(71, 'x') }) {
+		ASSERT_HINT(!stop_words.Contains(word), word);
+	}
+	size_t visited = 0;
+	stop_words.ForEach([&visited, &words](const string& word) {
+		ASSERT(words.count(word) > 0);
+		++visited;
+		});
+	ASSERT_EQUAL(visited, words.size());
+	ASSERT(!StopWordSet().Contains("a"s));
+}
+
+void TestDenseScoreAccumulator() {
+	SearchServer server(""s);
+	for (int id = 0; id < 300; ++id) {
+		server.AddDocument(id, "common"s + (id % 3 == 0 ? " fizz"s : ""s) + (id % 5 == 0 ? " buzz"s : ""s) + " id"s + to_string(id),
+			DocumentStatus::ACTUAL, { id % 17 });
+	}
+	const auto check = [&server](const string& query) {
+		const auto seq = server.FindTopDocuments(query, DocumentStatus::ACTUAL, 0, 300);
+		const auto par = server.FindTopDocuments(execution::par, query, DocumentStatus::ACTUAL, 0, 300);
+		ASSERT_EQUAL_HINT(seq.size(), par.size(), query);
+		for (size_t i = 0; i < seq.size(); ++i) {
+			ASSERT_EQUAL(seq[i].id, par[i].id);
+			ASSERT(abs(seq[i].relevance - par[i].relevance) < EPS);
+		}
+		return seq;
+	};
+	const auto broad = check("common fizz -buzz"s);
+	ASSERT_EQUAL(broad.size(), 240u);
+	ASSERT_EQUAL(check("id7 id8"s).size(), 2u);
+
+	try {
+		server.FindTopDocuments("fizz common"s, [](int document_id, DocumentStatus, int) {
+			if (document_id == 150) {
+				throw runtime_error("interrupted"s);
+			}
+			return true;
+			});
+		ASSERT_HINT(false, "Predicate exception must propagate"s);
+	}
+	catch (const runtime_error&) {
+	}
+	const auto again = check("common fizz -buzz"s);
+	ASSERT_EQUAL(again.size(), broad.size());
+	for (size_t i = 0; i < again.size(); ++i) {
+		ASSERT(abs(again[i].relevance - broad[i].relevance) < EPS);
+	}
+}
+
+void TestConjunctiveQuery() {
+	SearchServer server("and"s);
+	for (int id = 0; id < 400; ++id) {
+		string text = "word"s;
+		if (id % 2 == 0) {
+			text += " even"s;
+		}
+		if (id % 3 == 0) {
+			text += " three"s;
+		}
+		if (id % 50 == 0) {
+			text += " fifty"s;
+		}
+		server.AddDocument(id, text, DocumentStatus::ACTUAL, { id % 7 });
+	}
+	SearchOptions options;
+	options.mode = QueryMode::ALL;
+	const auto all = server.FindTopDocuments(execution::seq, "even three fifty"s, [](int, DocumentStatus, int) {
+		return true;
+		}, options);
+	ASSERT_EQUAL(all.size(), 3u);
+	for (const Document& document : all) {
+		ASSERT_EQUAL(document.id % 150, 0);
+	}
+	const auto filtered = server.FindTopDocuments(execution::par, "even three -fifty"s, [](int document_id, DocumentStatus, int) {
+		return document_id < 100;
+		}, options);
+	ASSERT_EQUAL(filtered.size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+	for (const Document& document : filtered) {
+		ASSERT(document.id % 6 == 0 && document.id != 0 && document.id < 100);
+	}
+	ASSERT(server.FindTopDocuments("even unknown"s, DocumentStatus::ACTUAL, options).empty());
+	ASSERT_EQUAL(server.FindTopDocuments("even unknown"s).size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+	try {
+		server.FindTopDocuments("eve*"s, DocumentStatus::ACTUAL, options);
+		ASSERT_HINT(false, "Prefix words must be rejected in ALL mode"s);
+	}
+	catch (const invalid_argument&) {
+	}
+}
+
+void TestQueryPlanner() {
+	SearchServer server("and"s);
+	for (int id = 0; id < 20; ++id) {
+		string text = "word"s;
+		if (id % 10 == 0) {
+			text += " cat"s;
+		}
+		if (id % 4 == 0) {
+			text += " dog"s;
+		}
+		server.AddDocument(id, text, DocumentStatus::ACTUAL, { id });
+	}
+	const QueryPlan plan = server.ExplainQuery("word dog cat unknown -dog"s);
+	ASSERT_EQUAL(plan.scored_terms.size(), 2u);
+	ASSERT_EQUAL(plan.scored_terms[0].word, "cat"sv);
+	ASSERT_EQUAL(plan.scored_terms[1].word, "dog"sv);
+	ASSERT_EQUAL(plan.zero_weight_terms.size(), 1u);
+	ASSERT_EQUAL(plan.zero_weight_terms[0].word, "word"sv);
+	ASSERT_EQUAL(plan.unknown_words.size(), 1u);
+	ASSERT_EQUAL(plan.estimated_postings, 7u);
+	ostringstream explain;
+	explain << plan;
+	ASSERT(explain.str().find("skip word"s) != string::npos);
+
+	// Documents with only the zero-IDF word fill the page after the scored ones
+	const auto documents = server.FindTopDocuments("word cat"s);
+	ASSERT_EQUAL(documents.size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+	ASSERT_EQUAL(documents[0].id, 10);
+	ASSERT_EQUAL(documents[1].id, 0);
+	ASSERT_EQUAL(documents[2].id, 19);
+	ASSERT(abs(documents[2].relevance) < EPS);
+	const auto parallel = server.FindTopDocuments(execution::par, "word cat"s);
+	ASSERT_EQUAL(parallel.size(), documents.size());
+	for (size_t i = 0; i < documents.size(); ++i) {
+		ASSERT_EQUAL(parallel[i].id, documents[i].id);
+	}
+	for (const Document& document : server.FindTopDocuments("word -cat"s, DocumentStatus::ACTUAL, 0, 100)) {
+		ASSERT(document.id % 10 != 0);
+	}
+	SearchOptions options;
+	options.mode = QueryMode::ALL;
+	ASSERT_EQUAL(server.FindTopDocuments("word cat"s, DocumentStatus::ACTUAL, options).size(), 2u);
+	ASSERT_EQUAL(server.FindTopDocuments("word"s, DocumentStatus::ACTUAL, options).size(),
+		static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+}
+
+void TestQueryStats() {
+	SearchServer server("and in"s);
+	for (int id = 0; id < 10; ++id) {
+		server.AddDocument(id, id % 2 == 0 ? "cat in city"s : "dog and cat"s, DocumentStatus::ACTUAL, { id });
+	}
+	server.AddDocument(10, "dog"s, DocumentStatus::BANNED, { 1 });
+	for (const bool parallel : { false, true }) {
+		QueryStats stats;
+		SearchOptions options;
+		options.stats = &stats;
+		const auto predicate = [](int document_id, DocumentStatus, int) {
+			return document_id < 8;
+		};
+		const auto documents = parallel
+			? server.FindTopDocuments(execution::par, "dog city and -cat7 -city ghost"s, predicate, options)
+			: server.FindTopDocuments(execution::seq, "dog city and -cat7 -city ghost"s, predicate, options);
+		ASSERT_EQUAL(documents.size(), 4u);
+		ASSERT_EQUAL(stats.terms_parsed, 6u);
+		ASSERT_EQUAL(stats.stop_words, 1u);
+		ASSERT_EQUAL(stats.unknown_terms, 1u);
+		ASSERT_EQUAL(stats.documents_excluded, 5u);
+		// dog and city postings; the five city documents are excluded before the predicate
+		ASSERT_EQUAL(stats.postings_scanned, 11u);
+		ASSERT_EQUAL(stats.predicate_evaluations, 6u);
+		ASSERT_EQUAL(stats.documents_scored, 4u);
+		ASSERT_EQUAL(stats.candidates, 4u);
+		ASSERT(stats.parse_time.count() > 0 && stats.score_time.count() > 0);
+		ostringstream out;
+		out << stats;
+		ASSERT(!out.str().empty());
+	}
+}
+
+// File name in the system temporary directory, unique to the run
+string MakeTempFilePath(const string& prefix) {
+	const auto name = prefix + to_string(random_device{}()) + ".txt"s;
+	return (filesystem::temp_directory_path() / name).string();
+}
+
+void TestBorrowedDocuments() {
+	const string path = MakeTempFilePath("search_server_test_corpus_"s);
+	{
+		ofstream out(path);
+		out << "white cat and fancy collar\nfluffy cat fluffy tail\ngroomed dog expressive eyes\n"s;
+	}
+	SearchServer server("and"s);
+	{
+		const auto file = MappedFile::Open(path);
+		const string_view data = file->GetData();
+		string_view rest = data;
+		int id = 0;
+		while (!rest.empty()) {
+			const size_t end = rest.find('\n');
+			server.AddDocument(id++, rest.substr(0, end), DocumentStatus::ACTUAL, { id }, file);
+			rest.remove_prefix(end == rest.npos ? rest.size() : end + 1);
+		}
+		// Document words point into the mapping, dictionary terms do not
+		for (const auto& [word, freq] : server.GetWordFrequencies(1)) {
+			ASSERT(word.data() >= data.data() && word.data() < data.data() + data.size());
+		}
+		const auto [words, status] = server.MatchDocument("fluffy cat"s, 1);
+		for (string_view word : words) {
+			ASSERT(word.data() < data.data() || word.data() >= data.data() + data.size());
+		}
+	}
+	remove(path.c_str());
+
+	// The server keeps the mapping alive
+	const auto documents = server.FindTopDocuments("fluffy groomed cat"s);
+	ASSERT_EQUAL(documents.size(), 3u);
+	ASSERT_EQUAL(documents[0].id, 1);
+	server.AddDocument(3, "fluffy cat copied"s, DocumentStatus::ACTUAL, { 1 });
+	ASSERT_EQUAL(server.FindTopDocuments("copied"s).size(), 1u);
+
+	// A normalizing analysis copies the text
+	SearchServer folding("and"s, TextAnalysis{ true, false });
+	const string text = "Fluffy CAT"s;
+	folding.AddDocument(0, text, DocumentStatus::ACTUAL, { 1 }, nullptr);
+	ASSERT_EQUAL(text, "Fluffy CAT"s);
+	ASSERT_EQUAL(folding.FindTopDocuments("cat"s).size(), 1u);
+}
+
+void TestStreamingIngestion() {
+	const string corpus =
+		"1\tACTUAL\t1 2 3\twhite cat and fancy collar\n"s
+		"2\tACTUAL\t\tfluffy cat fluffy tail\r\n"s
+		"\n"s
+		"3\tBANNED\t-4\tgroomed dog expressive eyes\n"s
+		"x\tACTUAL\t1\tbroken id\n"s
+		"4\tUNKNOWN\t1\tbroken status\n"s
+		"5\tACTUAL\t1\tinvalid w\x01rd\n"s
+		"2\tACTUAL\t1\tduplicate id\n"s
+		"6\tIRRELEVANT\t7 7\tcat without line break"s;
+	SearchServer expected("and"s);
+	expected.AddDocument(1, "white cat and fancy collar"s, DocumentStatus::ACTUAL, { 1, 2, 3 });
+	expected.AddDocument(2, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, {});
+	expected.AddDocument(3, "groomed dog expressive eyes"s, DocumentStatus::BANNED, { -4 });
+	expected.AddDocument(6, "cat without line break"s, DocumentStatus::IRRELEVANT, { 7, 7 });
+
+	const auto check = [&expected](const SearchServer& server, const IngestionStats& stats) {
+		ASSERT_EQUAL(stats.documents_indexed, 4u);
+		ASSERT_EQUAL(stats.documents_rejected, 4u);
+		ASSERT_EQUAL(server.GetDocumentCount(), 4);
+		for (const DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::BANNED, DocumentStatus::IRRELEVANT }) {
+			const auto documents = server.FindTopDocuments("fluffy cat dog eyes"s, status);
+			const auto expected_documents = expected.FindTopDocuments("fluffy cat dog eyes"s, status);
+			ASSERT_EQUAL(documents.size(), expected_documents.size());
+			for (size_t i = 0; i < documents.size(); ++i) {
+				ASSERT_EQUAL(documents[i].id, expected_documents[i].id);
+				ASSERT_EQUAL(documents[i].rating, expected_documents[i].rating);
+				ASSERT(abs(documents[i].relevance - expected_documents[i].relevance) < EPS);
+			}
+		}
+	};
+
+	// Tiny chunks and queues to exercise the stalls and lines across chunks
+	IngestionOptions options;
+	options.worker_count = 3;
+	options.chunk_size = 16;
+	options.queue_capacity = 2;
+
+	SearchServer from_stream("and"s);
+	istringstream input(corpus);
+	const IngestionStats stream_stats = IngestDocuments(from_stream, input, options);
+	ASSERT_EQUAL(stream_stats.bytes_read, corpus.size());
+	check(from_stream, stream_stats);
+
+	const string path = MakeTempFilePath("search_server_test_ingestion_"s);
+	{
+		ofstream out(path, ios::binary);
+		out << corpus;
+	}
+	SearchServer from_file("and"s);
+	const IngestionStats file_stats = IngestDocuments(from_file, path, options);
+	remove(path.c_str());
+	check(from_file, file_stats);
+
+	SearchServer folding("and"s, TextAnalysis{ true, false });
+	istringstream upper_input("1\tACTUAL\t1\tWhite CAT\n"s);
+	ASSERT_EQUAL(IngestDocuments(folding, upper_input).documents_indexed, 1u);
+	ASSERT_EQUAL(folding.FindTopDocuments("cat white"s).size(), 1u);
+
+	IngestionOptions empty_chunks;
+	empty_chunks.chunk_size = 0;
+	SearchServer rejected("and"s);
+	istringstream rejected_input(corpus);
+	try {
+		IngestDocuments(rejected, rejected_input, empty_chunks);
+		ASSERT_HINT(false, "Zero chunk size must be rejected"s);
+	}
+	catch (const invalid_argument&) {
+	}
+	try {
+		IngestDocuments(rejected, "missing_corpus.txt"s, empty_chunks);
+		ASSERT_HINT(false, "Zero chunk size must be rejected"s);
+	}
+	catch (const invalid_argument&) {
+	}
+	ASSERT_EQUAL(rejected.GetDocumentCount(), 0);
+}
+
+void TestUpdateDocument() {
+	SearchServer server("and in"s);
+	server.AddDocument(0, "white cat and fancy collar"s, DocumentStatus::ACTUAL, { 8 });
+	server.AddDocument(1, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, { 7 });
+	server.AddDocument(2, "groomed dog expressive eyes"s, DocumentStatus::ACTUAL, { 5 });
+	server.UpdateDocument(1, "fluffy dog fluffy tail in collar"s, DocumentStatus::ACTUAL, { 1, 3 });
+
+	SearchServer expected("and in"s);
+	expected.AddDocument(0, "white cat and fancy collar"s, DocumentStatus::ACTUAL, { 8 });
+	expected.AddDocument(1, "fluffy dog fluffy tail in collar"s, DocumentStatus::ACTUAL, { 2 });
+	expected.AddDocument(2, "groomed dog expressive eyes"s, DocumentStatus::ACTUAL, { 5 });
+	for (const auto& query : { "cat"s, "fluffy dog collar"s, "tail -groomed"s }) {
+		const auto documents = server.FindTopDocuments(query);
+		const auto expected_documents = expected.FindTopDocuments(query);
+		ASSERT_EQUAL(documents.size(), expected_documents.size());
+		for (size_t i = 0; i < documents.size(); ++i) {
+			ASSERT_EQUAL(documents[i].id, expected_documents[i].id);
+			ASSERT_EQUAL(documents[i].rating, expected_documents[i].rating);
+			ASSERT(abs(documents[i].relevance - expected_documents[i].relevance) < EPS);
+		}
+	}
+	ASSERT(get<0>(server.MatchDocument("cat"s, 1)).empty());
+	ASSERT_EQUAL(server.GetWordFrequencies(1).size(), 4u);
+
+	// Updates keep no copy of the text, only the terms new to the dictionary
+	const size_t retained_text = server.GetMemoryStats().retained_text;
+	for (int i = 0; i < 100; ++i) {
+		server.UpdateDocument(1, i % 2 == 0 ? "fluffy cat fluffy tail"s : "fluffy dog fluffy tail in collar"s,
+			DocumentStatus::ACTUAL, { 1, 3 });
+	}
+	ASSERT_EQUAL(server.GetMemoryStats().retained_text, retained_text);
+	ASSERT_EQUAL(server.FindTopDocuments("fluffy collar"s).size(), 2u);
+
+	server.UpdateStatus(2, DocumentStatus::BANNED);
+	ASSERT(server.FindTopDocuments("groomed"s).empty());
+	ASSERT_EQUAL(server.FindTopDocuments("groomed"s, DocumentStatus::BANNED).size(), 1u);
+	server.UpdateRating(0, { 0 });
+	ASSERT_EQUAL(server.FindTopDocuments("cat"s)[0].rating, 0);
+
+	try {
+		server.UpdateDocument(0, "broken w\x01rd"s, DocumentStatus::ACTUAL, { 1 });
+		ASSERT_HINT(false, "Invalid words must be rejected"s);
+	}
+	catch (const invalid_argument&) {
+	}
+	ASSERT_EQUAL(server.FindTopDocuments("white"s).size(), 1u);
+	try {
+		server.UpdateStatus(5, DocumentStatus::ACTUAL);
+		ASSERT_HINT(false, "Unknown documents must be rejected"s);
+	}
+	catch (const out_of_range&) {
+	}
+}
+
+void TestRemoveDocumentsBatch() {
+	const auto make_server = [](std::pmr::memory_resource* resource = std::pmr::get_default_resource()) {
+		SearchServer server("and"s, TextAnalysis{}, resource);
+		for (int id = 0; id < 500; ++id) {
+			server.AddDocument(id, "word"s + to_string(id % 7) + " word"s + to_string(id % 11) + " common"s,
+				DocumentStatus::ACTUAL, { id % 5 });
+		}
+		return server;
+	};
+	vector<int> removed;
+	for (int id = 0; id < 500; id += 3) {
+		removed.push_back(id);
+	}
+	removed.push_back(3);
+	removed.push_back(1000);
+
+	SearchServer expected = make_server();
+	for (int id = 0; id < 500; id += 3) {
+		expected.RemoveDocument(execution::par, id);
+	}
+	SearchServer sequential = make_server();
+	sequential.RemoveDocuments(execution::seq, removed);
+	SearchServer parallel = make_server();
+	parallel.RemoveDocuments(execution::par, removed);
+	// Erased sequentially: the pool is not thread-safe
+	std::pmr::unsynchronized_pool_resource unsynchronized_pool;
+	SearchServer unsynchronized = make_server(&unsynchronized_pool);
+	unsynchronized.RemoveDocuments(execution::par, removed);
+	unsynchronized.RemoveDocument(execution::par, 1);
+	unsynchronized.AddDocument(1, "word1 word1 common"s, DocumentStatus::ACTUAL, { 1 });
+	std::pmr::synchronized_pool_resource synchronized_pool;
+	SearchServer synchronized = make_server(&synchronized_pool);
+	synchronized.RemoveDocuments(execution::par, removed);
+
+	for (const SearchServer* server : { &sequential, &parallel, &unsynchronized, &synchronized }) {
+		ASSERT_EQUAL(server->GetDocumentCount(), expected.GetDocumentCount());
+		for (const auto& query : { "word0 word3"s, "common -word5"s, "word10"s }) {
+			const auto documents = server->FindTopDocuments(query, DocumentStatus::ACTUAL, 0, 1000);
+			const auto expected_documents = expected.FindTopDocuments(query, DocumentStatus::ACTUAL, 0, 1000);
+			ASSERT_EQUAL(documents.size(), expected_documents.size());
+			for (size_t i = 0; i < documents.size(); ++i) {
+				ASSERT_EQUAL(documents[i].id, expected_documents[i].id);
+				ASSERT(documents[i].id % 3 != 0);
+			}
+		}
+		ASSERT(server->GetWordFrequencies(0).empty());
+	}
+}
+
+void TestIndexMemoryResource() {
+	CountingMemoryResource counting;
+	{
+		SearchServer server("and"s, TextAnalysis{}, &counting);
+		server.AddDocument(0, "white cat and fancy collar"s, DocumentStatus::ACTUAL, { 8 });
+		server.AddDocument(1, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, { 7 });
+		server.AddDocument(2, "groomed dog expressive eyes"s, DocumentStatus::ACTUAL, { 5 });
+		// Three documents, their words and postings
+		ASSERT(counting.GetAllocationCount() >= 3 + 12 + 12);
+		const size_t allocation_count = counting.GetAllocationCount();
+		ASSERT_EQUAL(server.FindTopDocuments("fluffy cat"s).size(), 2u);
+		ASSERT_EQUAL(counting.GetAllocationCount(), allocation_count);
+		server.RemoveDocument(1);
+		ASSERT(counting.GetDeallocationCount() > 0);
+	}
+	// Every node went back to the resource
+	ASSERT_EQUAL(counting.GetBytesInUse(), 0u);
+	ASSERT_EQUAL(counting.GetAllocationCount(), counting.GetDeallocationCount());
+
+	std::pmr::monotonic_buffer_resource arena;
+	SearchServer server("and"s, TextAnalysis{}, &arena);
+	server.AddDocument(0, "white cat and fancy collar"s, DocumentStatus::ACTUAL, { 8 });
+	server.AddDocument(1, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, { 7 });
+	const auto documents = server.FindTopDocuments("fluffy cat"s);
+	ASSERT_EQUAL(documents.size(), 2u);
+	ASSERT_EQUAL(documents[0].id, 1);
+}
+
+void TestImpactOrderedSearch() {
+	{
+		vector<ImpactOrderedPostings::Posting> postings;
+		for (int i = 0; i < 300; ++i) {
+			postings.push_back({ i, 1.0f / (1 + i % 37) });
+		}
+		const ImpactOrderedPostings impact_postings(postings);
+		ASSERT_EQUAL(impact_postings.size(), postings.size());
+		ASSERT(impact_postings.GetBlockCount() > 1);
+		size_t posting_count = 0;
+		for (size_t block = 0; block < impact_postings.GetBlockCount(); ++block) {
+			if (block > 0) {
+				ASSERT(impact_postings.GetBlockImpact(block) < impact_postings.GetBlockImpact(block - 1));
+			}
+			for (auto it = impact_postings.GetBlockBegin(block); it != impact_postings.GetBlockEnd(block); ++it) {
+				ASSERT(it->term_freq <= impact_postings.GetBlockImpact(block));
+				ASSERT(it == impact_postings.GetBlockBegin(block) || (it - 1)->slot < it->slot);
+				++posting_count;
+			}
+		}
+		ASSERT_EQUAL(posting_count, postings.size());
+	}
+
+	SearchServer server(""s);
+	// Five documents with a rare word rank above fifteen with a common one
+	for (int id = 0; id < 5; ++id) {
+		server.AddDocument(id, "rare"s, DocumentStatus::ACTUAL, { id });
+	}
+	for (int id = 5; id < 20; ++id) {
+		server.AddDocument(id, "common word word word"s + (id % 2 == 0 ? " even"s : ""s), DocumentStatus::ACTUAL, { id });
+	}
+	const auto check_same = [](const vector<Document>& lhs, const vector<Document>& rhs) {
+		ASSERT_EQUAL(lhs.size(), rhs.size());
+		for (size_t i = 0; i < lhs.size(); ++i) {
+			ASSERT_EQUAL(lhs[i].id, rhs[i].id);
+			ASSERT(abs(lhs[i].relevance - rhs[i].relevance) < EPS);
+		}
+	};
+	SearchOptions options;
+	options.posting_budget = 1;
+	const auto exact = server.FindTopDocuments("rare common"s);
+	// Without the impact index the budget is ignored
+	ASSERT_EQUAL(server.ExplainQuery("rare common"s, options).posting_budget, 0u);
+	check_same(server.FindTopDocuments("rare common"s, DocumentStatus::ACTUAL, options), exact);
+
+	server.BuildImpactIndex();
+	ASSERT(server.HasImpactIndex());
+	ASSERT_EQUAL(server.ExplainQuery("rare common"s, options).posting_budget, 1u);
+
+	// The page is settled after the rare word: the common one adds too little
+	QueryStats stats;
+	options.posting_budget = numeric_limits<size_t>::max();
+	options.stats = &stats;
+	check_same(server.FindTopDocuments("rare common"s, DocumentStatus::ACTUAL, options), exact);
+	ASSERT(stats.postings_scanned < 20);
+	options.stats = nullptr;
+	check_same(server.FindTopDocuments("common even -word"s, DocumentStatus::ACTUAL, options),
+		server.FindTopDocuments("common even -word"s));
+	check_same(server.FindTopDocuments("common even"s, DocumentStatus::ACTUAL, options),
+		server.FindTopDocuments("common even"s));
+
+	// A budget of one posting finds one document, with its exact relevance
+	options.posting_budget = 1;
+	const auto approximate = server.FindTopDocuments("rare common"s, DocumentStatus::ACTUAL, options);
+	ASSERT_EQUAL(approximate.size(), 1u);
+	ASSERT(approximate[0].id < 5);
+	ASSERT(abs(approximate[0].relevance - exact[0].relevance) < EPS);
+
+	server.AddDocument(20, "rare common"s, DocumentStatus::ACTUAL, { 0 });
+	ASSERT(!server.HasImpactIndex());
+	ASSERT_EQUAL(server.FindTopDocuments("rare common"s, DocumentStatus::ACTUAL, options).size(), 5u);
+}
+
+void TestHybridPostingList() {
+	HybridPostingList postings;
+	map<int, double> expected;
+	const auto check_same = [&]() {
+		ASSERT_EQUAL(postings.size(), expected.size());
+		auto it = expected.begin();
+		for (const auto [document_id, term_freq] : postings) {
+			ASSERT(it != expected.end());
+			ASSERT_EQUAL(document_id, it->first);
+			ASSERT_EQUAL(term_freq, it->second);
+			++it;
+		}
+		ASSERT(it == expected.end());
+	};
+	// Every third id of the first chunk turns it into a bitmap, the other two stay arrays
+	for (int document_id = 0; document_id < 30000; document_id += 3) {
+		postings[document_id] = expected[document_id] = document_id * 0.5;
+	}
+	for (const int document_id : { 70000, 70001, 200000, 1 }) {
+		postings[document_id] += 1.0;
+		expected[document_id] += 1.0;
+	}
+	check_same();
+	ASSERT_HINT(postings.GetMemoryUsage() < expected.size() * 24, "A posting must take a fraction of a map node"s);
+	ASSERT_EQUAL(postings.count(29997), 1u);
+	ASSERT_EQUAL(postings.count(29998), 0u);
+	ASSERT_EQUAL(postings.at(70001), 1.0);
+	try {
+		postings.at(70002);
+		ASSERT_HINT(false, "A missing posting must throw"s);
+	}
+	catch (const out_of_range&) {
+	}
+
+	auto cursor = postings.begin();
+	for (const int target : { 2, 3, 29998, 69999, 70001, 100000, 300000 }) {
+		postings.SkipTo(cursor, target);
+		const auto expected_it = expected.lower_bound(target);
+		if (expected_it == expected.end()) {
+			ASSERT(cursor == postings.end());
+		}
+		else {
+			ASSERT_EQUAL(cursor->first, expected_it->first);
+		}
+	}
+
+	DocumentBitset documents;
+	postings.AddTo(documents);
+	ASSERT_EQUAL(documents.Count(), expected.size());
+	ASSERT(documents.Test(29997) && documents.Test(200000) && !documents.Test(29998));
+
+	// Every 1000th id, from bitmap and array chunks alike
+	const vector<int> sampled_ids = postings.SampleIds(1000);
+	ASSERT_EQUAL(sampled_ids.size(), (expected.size() - 1) / 1000);
+	auto expected_it = expected.begin();
+	for (const int document_id : sampled_ids) {
+		advance(expected_it, 1000);
+		ASSERT_EQUAL(document_id, expected_it->first);
+	}
+
+	// Erasing most of the bitmap turns it back into an array
+	vector<int> erased_ids;
+	for (int document_id = 0; document_id < 27000; document_id += 3) {
+		erased_ids.push_back(document_id);
+		expected.erase(document_id);
+	}
+	erased_ids.push_back(70000);
+	expected.erase(70000);
+	postings.EraseSorted(erased_ids);
+	check_same();
+	ASSERT_EQUAL(postings.erase(200000), 1u);
+	ASSERT_EQUAL(postings.erase(200000), 0u);
+	expected.erase(200000);
+	postings[27001] = expected[27001] = 2.0;
+	check_same();
+
+}
+
+void TestSearchCancellation() {
+	SearchServer server(""s);
+	for (int id = 0; id < 3000; ++id) {
+		string text = "cat"s;
+		for (int i = 0; i < id % 7; ++i) {
+			text += " tail"s;
+		}
+		server.AddDocument(id, text, DocumentStatus::ACTUAL, { id });
+	}
+	bool truncated = true;
+	SearchOptions options;
+	options.truncated = &truncated;
+	const auto exact = server.FindTopDocuments("cat"s, DocumentStatus::ACTUAL, options);
+	ASSERT(!truncated);
+	ASSERT_EQUAL(exact.size(), 5u);
+
+	const CancellationToken far_deadline = CancellationToken::WithTimeout(1h);
+	options.cancellation = &far_deadline;
+	ASSERT_EQUAL(server.FindTopDocuments("cat"s, DocumentStatus::ACTUAL, options).size(), 5u);
+	ASSERT(!truncated);
+
+	// A token that has already fired stops the search before scoring
+	const CancellationToken past_deadline = CancellationToken::WithTimeout(0s);
+	options.cancellation = &past_deadline;
+	ASSERT(server.FindTopDocuments("cat"s, DocumentStatus::ACTUAL, options).empty());
+	ASSERT(truncated);
+
+	// Cancelled while scoring: the page is ranked from the documents scored so far
+	for (const bool parallel : { false, true }) {
+		CancellationToken token;
+		QueryStats stats;
+		options.cancellation = &token;
+		options.stats = &stats;
+		const auto cancel_on_first_document = [&token](int, DocumentStatus, int) {
+			token.Cancel();
+			return true;
+		};
+		const auto partial = parallel
+			? server.FindTopDocuments(execution::par, "cat"s, cancel_on_first_document, options)
+			: server.FindTopDocuments(execution::seq, "cat"s, cancel_on_first_document, options);
+		ASSERT(truncated);
+		ASSERT_EQUAL(partial.size(), 5u);
+		ASSERT(stats.documents_scored < 3000);
+	}
+	options.stats = nullptr;
+
+	vector<bool> truncated_queries;
+	const auto answers = ProcessQueries(server, { "cat"s, "tail"s }, past_deadline, truncated_queries);
+	ASSERT_EQUAL(truncated_queries, vector<bool>({ true, true }));
+	ASSERT(answers[0].empty() && answers[1].empty());
+	ProcessQueries(server, { "cat"s, "dog"s }, far_deadline, truncated_queries);
+	ASSERT_EQUAL(truncated_queries, vector<bool>({ false, false }));
+
+	RequestQueue request_queue(server);
+	request_queue.AddFindRequest("cat"s, DocumentStatus::ACTUAL, past_deadline);
+	request_queue.AddFindRequest("cat"s, DocumentStatus::ACTUAL, far_deadline);
+	ASSERT_EQUAL(request_queue.GetTruncatedRequests(), 1);
+}
+
+void TestParallelRangeScan() {
+	// A single long posting list spans several id ranges of the parallel scan
+	SearchServer server(""s);
+	const vector<string> words = { "cat"s, "dog"s, "bird"s, "fish"s };
+	const int document_count = static_cast<int>(PARALLEL_CHUNK_POSTINGS) * 3;
+	for (int id = 0; id < document_count; ++id) {
+		string text = "cat"s;
+		for (int i = 0; i < id % 5; ++i) {
+			text += ' ' + words[(id / 5 + i) % words.size()];
+		}
+		server.AddDocument(id, text, id % 3 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, { id % 100 });
+	}
+	const auto odd = [](int document_id, DocumentStatus, int) {
+		return document_id % 2 == 1;
+	};
+	for (const auto& query : { "cat"s, "cat dog"s, "dog bird -fish"s, "fish cat -bird"s }) {
+		const auto sequential = server.FindTopDocuments(execution::seq, query, DocumentStatus::ACTUAL, 0, document_count);
+		const auto parallel = server.FindTopDocuments(execution::par, query, DocumentStatus::ACTUAL, 0, document_count);
+		ASSERT(!sequential.empty());
+		ASSERT_EQUAL(parallel.size(), sequential.size());
+		for (size_t i = 0; i < sequential.size(); ++i) {
+			ASSERT_EQUAL(parallel[i].id, sequential[i].id);
+			ASSERT_EQUAL(parallel[i].relevance, sequential[i].relevance);
+		}
+		const auto sequential_odd = server.FindTopDocuments(execution::seq, query, odd, 0, document_count);
+		const auto parallel_odd = server.FindTopDocuments(execution::par, query, odd, 0, document_count);
+		ASSERT_EQUAL(parallel_odd.size(), sequential_odd.size());
+		for (size_t i = 0; i < sequential_odd.size(); ++i) {
+			ASSERT_EQUAL(parallel_odd[i].id, sequential_odd[i].id);
+		}
+	}
+}
+
+void TestSparseDocumentIds() {
+	const int max_id = numeric_limits<int>::max();
+	SearchServer server("and"s);
+	server.AddDocument(100000000, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, { 7 });
+	server.AddDocument(max_id - 1, "white cat and fancy collar"s, DocumentStatus::ACTUAL, { 8 });
+	server.AddDocument(max_id, "groomed dog expressive eyes"s, DocumentStatus::BANNED, { 5 });
+	server.AddDocument(5, "cat and dog"s, DocumentStatus::ACTUAL, { 1 });
+	// The columns and bitsets grow with the document count, not with the ids
+	ASSERT(server.GetMemoryStats().document_attributes < 4096);
+
+	auto documents = server.FindTopDocuments("fluffy cat"s);
+	ASSERT_EQUAL(documents.size(), 3u);
+	ASSERT_EQUAL(documents[0].id, 100000000);
+	ASSERT_EQUAL(documents[0].rating, 7);
+	documents = server.FindTopDocuments(execution::par, "dog -eyes"s, [](int document_id, DocumentStatus, int) {
+		return document_id < 10;
+	});
+	ASSERT_EQUAL(documents.size(), 1u);
+	ASSERT_EQUAL(documents[0].id, 5);
+	documents = server.FindTopDocuments("dog"s, DocumentStatus::BANNED);
+	ASSERT_EQUAL(documents.size(), 1u);
+	ASSERT_EQUAL(documents[0].id, max_id);
+
+	const auto [words, status] = server.MatchDocument("cat collar -dog"s, max_id - 1);
+	ASSERT_EQUAL(words.size(), 2u);
+	ASSERT(status == DocumentStatus::ACTUAL);
+	server.UpdateStatus(max_id, DocumentStatus::ACTUAL);
+	server.UpdateDocument(max_id - 1, "white parrot"s, DocumentStatus::ACTUAL, { 2 });
+	DocumentFilter filter;
+	filter.min_rating = 2;
+	documents = server.FindTopDocuments("dog parrot"s, filter);
+	ASSERT_EQUAL(documents.size(), 2u);
+	ASSERT_EQUAL(documents[0].id, max_id - 1);
+	ASSERT_EQUAL(documents[1].id, max_id);
+
+	// A removed document's slot goes to the next document without its postings
+	server.RemoveDocument(100000000);
+	server.AddDocument(7, "white dog"s, DocumentStatus::ACTUAL, { 3 });
+	ASSERT(server.FindTopDocuments("fluffy tail"s).empty());
+	documents = server.FindTopDocuments("white"s);
+	ASSERT_EQUAL(documents.size(), 2u);
+	ASSERT_EQUAL(documents[0].id, 7);
+	ASSERT_EQUAL(documents[1].id, max_id - 1);
+	server.BuildImpactIndex();
+	SearchOptions options;
+	options.posting_budget = 100;
+	documents = server.FindTopDocuments("white dog"s, DocumentStatus::ACTUAL, options);
+	ASSERT_EQUAL(documents.size(), 4u);
+	ASSERT_EQUAL(documents[0].id, 7);
+	try {
+		server.MatchDocument("cat"s, 100000000);
+		ASSERT_HINT(false, "removed document must not match"s);
+	}
+	catch (const out_of_range&) {
+	}
+}
+
 
 
 void Test() {
@@ -408,4 +1782,33 @@ void TestSearchServer() {
 	RUN_TEST(TestResultFilterPredicate); //         ,  
 	RUN_TEST(TestFindAllDocument);  //      
 	RUN_TEST(TestCorrectRelevance);  //      
+	RUN_TEST(TestShardProtocol);
+#ifndef _WIN32
+	RUN_TEST(TestShardRouter);
+#endif
+	RUN_TEST(TestSegmentedSearchServer);
+	RUN_TEST(TestCompressedPostingList);
+	RUN_TEST(TestMemoryStats);
+	RUN_TEST(TestStatusFilterPushdown);
+	RUN_TEST(TestDocumentFilter);
+	RUN_TEST(TestMinusWordsExcludeBeforeScoring);
+	RUN_TEST(TestPagedSearch);
+	RUN_TEST(TestPrefixQuery);
+	RUN_TEST(TestFuzzySearch);
+	RUN_TEST(TestTextAnalysis);
+	RUN_TEST(TestStopWordSet);
+	RUN_TEST(TestDenseScoreAccumulator);
+	RUN_TEST(TestConjunctiveQuery);
+	RUN_TEST(TestQueryPlanner);
+	RUN_TEST(TestQueryStats);
+	RUN_TEST(TestBorrowedDocuments);
+	RUN_TEST(TestStreamingIngestion);
+	RUN_TEST(TestUpdateDocument);
+	RUN_TEST(TestRemoveDocumentsBatch);
+	RUN_TEST(TestIndexMemoryResource);
+	RUN_TEST(TestImpactOrderedSearch);
+	RUN_TEST(TestHybridPostingList);
+	RUN_TEST(TestSearchCancellation);
+	RUN_TEST(TestParallelRangeScan);
+	RUN_TEST(TestSparseDocumentIds);
 }
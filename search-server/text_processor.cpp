@@ -0,0 +1,88 @@
+#include "text_processor.h"
+#include <algorithm>
+
+using namespace std::string_literals;
+
+TextProcessor::TextProcessor(std::string_view stop_words_text, TextAnalysis analysis)
+    : TextProcessor(SplitStopWords(stop_words_text, analysis), analysis) {
+}
+
+const TextAnalysis& TextProcessor::GetAnalysis() const {
+    return analysis_;
+}
+
+const StopWordSet& TextProcessor::GetStopWords() const {
+    return stop_words_;
+}
+
+bool TextProcessor::IsStopWord(std::string_view word) const {
+    return stop_words_.Contains(word);
+}
+
+std::vector<std::string_view> TextProcessor::SplitStopWords(std::string_view text, const TextAnalysis& analysis) {
+    std::vector<std::string_view> words;
+    VisitAnalyzer(analysis, [text, &words](auto tokenizer, auto) {
+        decltype(tokenizer)::Tokenize(text, [&words](std::string_view word) {
+            words.push_back(word);
+            });
+        });
+    return words;
+}
+
+std::vector<std::string_view> TextProcessor::SplitIntoWordsNoStop(std::string& text) const {
+    std::vector<std::string_view> words;
+    VisitAnalyzer(analysis_, [this, &text, &words](auto tokenizer, auto normalizer) {
+        Analyzer<decltype(tokenizer), decltype(normalizer)>::Analyze(text,
+            [this](std::string_view word) {
+                return IsStopWord(word);
+            },
+            [&words](std::string_view word) {
+                if (!IsValidWord(word)) {
+                    throw std::invalid_argument("Word "s + std::string(word) + " is invalid"s);
+                }
+                words.push_back(word);
+            });
+        });
+    return words;
+}
+
+std::vector<std::string_view> TextProcessor::SplitIntoWordsNoStop(std::string_view text) const {
+    std::vector<std::string_view> words;
+    VisitAnalyzer(analysis_, [this, text, &words](auto tokenizer, auto) {
+        decltype(tokenizer)::Tokenize(text, [this, &words](std::string_view word) {
+            if (IsStopWord(word)) {
+                return;
+            }
+            if (!IsValidWord(word)) {
+                throw std::invalid_argument("Word "s + std::string(word) + " is invalid"s);
+            }
+            words.push_back(word);
+            });
+        });
+    return words;
+}
+
+TextProcessor::QueryWord TextProcessor::ParseQueryWord(std::string_view text) const {
+    if (text.empty()) {
+        throw std::invalid_argument("Query word is empty"s);
+    }
+    bool is_minus = false;
+    if (text[0] == '-') {
+        is_minus = true;
+        text = text.substr(1);
+    }
+    bool is_prefix = false;
+    if (!text.empty() && text.back() == '*') {
+        is_prefix = true;
+        text.remove_suffix(1);
+    }
+    if (text.empty() || text[0] == '-' || !IsValidWord(text)) {
+        throw std::invalid_argument("Query word "s + static_cast<std::string>(text) + " is invalid");
+    }
+    return { text, is_minus, !is_prefix && IsStopWord(text), is_prefix };
+}
+
+void TextProcessor::RemoveDuplicateWords(std::vector<std::string_view>& words) {
+    std::sort(words.begin(), words.end());
+    words.erase(std::unique(words.begin(), words.end()), words.end());
+}
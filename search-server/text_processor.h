@@ -0,0 +1,99 @@
+#pragma once
+#include "analyzer.h"
+#include "stop_word_set.h"
+#include "string_processing.h"
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Document and query text handling shared by SearchServer and
+// SegmentedSearchServer: stop words, tokenization with normalization and
+// the syntax of query words, so that both servers accept, reject and split
+// a text the same way.
+class TextProcessor {
+public:
+    struct QueryWord {
+        std::string_view data;
+        bool is_minus;
+        bool is_stop;
+        bool is_prefix;
+    };
+
+    // Throws invalid_argument for an invalid stop word
+    template <typename StringContainer>
+    explicit TextProcessor(const StringContainer& stop_words, TextAnalysis analysis = {});
+    explicit TextProcessor(std::string_view stop_words_text, TextAnalysis analysis = {});
+
+    const TextAnalysis& GetAnalysis() const;
+    const StopWordSet& GetStopWords() const;
+    bool IsStopWord(std::string_view word) const;
+
+    // Normalizes the text in place and returns its non-stop words
+    std::vector<std::string_view> SplitIntoWordsNoStop(std::string& text) const;
+    // Same for an analysis that does not normalize
+    std::vector<std::string_view> SplitIntoWordsNoStop(std::string_view text) const;
+
+    QueryWord ParseQueryWord(std::string_view text) const;
+    // Calls function(QueryWord) for every word of the query. When the analysis
+    // normalizes, the words are views of normalized_text, a normalized copy.
+    template <typename Function>
+    void ForEachQueryWord(std::string_view text, std::unique_ptr<std::string>& normalized_text,
+        Function function) const;
+
+    // Sorts the words and drops repeats
+    static void RemoveDuplicateWords(std::vector<std::string_view>& words);
+
+private:
+    TextAnalysis analysis_;
+    StopWordSet stop_words_;
+
+    template <typename StringContainer>
+    static std::set<std::string, std::less<>> MakeStopWords(const StringContainer& stop_words,
+        const TextAnalysis& analysis);
+    static std::vector<std::string_view> SplitStopWords(std::string_view text, const TextAnalysis& analysis);
+};
+
+template <typename StringContainer>
+TextProcessor::TextProcessor(const StringContainer& stop_words, TextAnalysis analysis)
+    : analysis_(analysis)
+    , stop_words_(MakeStopWords(stop_words, analysis)) {
+    using namespace std::string_literals;
+    stop_words_.ForEach([](const std::string& word) {
+        if (!IsValidWord(word)) {
+            throw std::invalid_argument("Some of stop words are invalid"s);
+        }
+        });
+}
+
+template <typename StringContainer>
+std::set<std::string, std::less<>> TextProcessor::MakeStopWords(const StringContainer& stop_words,
+    const TextAnalysis& analysis) {
+    std::set<std::string, std::less<>> result;
+    for (std::string word : MakeUniqueNonEmptyStrings(stop_words)) {
+        // Stop words go through the same normalization as the documents
+        if (analysis.fold_case) {
+            CaseFoldNormalizer::Normalize(word.data(), word.size());
+        }
+        result.insert(std::move(word));
+    }
+    return result;
+}
+
+template <typename Function>
+void TextProcessor::ForEachQueryWord(std::string_view text, std::unique_ptr<std::string>& normalized_text,
+    Function function) const {
+    VisitAnalyzer(analysis_, [&](auto tokenizer, auto normalizer) {
+        using Normalizer = decltype(normalizer);
+        if constexpr (Normalizer::MODIFIES_TEXT) {
+            normalized_text = std::make_unique<std::string>(text);
+            Normalizer::Normalize(normalized_text->data(), normalized_text->size());
+            text = *normalized_text;
+        }
+        decltype(tokenizer)::Tokenize(text, [&](std::string_view word) {
+            function(ParseQueryWord(word));
+            });
+        });
+}